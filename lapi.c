@@ -633,6 +633,26 @@ LUA_API void lua_pushcclosure (lua_State *L, lua_CFunction fn, int n) {
 }
 
 
+/*
+** Push a leaf C function: a call passing it exactly 'nargs' arguments
+** goes directly from the interpreter to the function (see
+** 'luaD_callleaf'). A leaf must not call Lua functions (including
+** metamethods) nor yield.
+*/
+LUA_API void lua_pushleaf (lua_State *L, lua_CFunction fn, int nargs) {
+  CClosure *cl;
+  lua_lock(L);
+  api_check(L, 0 <= nargs && nargs < MAXUPVAL, "invalid number of arguments");
+  cl = luaF_newCclosure(L, 0);
+  cl->f = fn;
+  cl->leaf = cast_byte(nargs + 1);
+  setclCvalue(L, s2v(L->top.p), cl);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
 LUA_API void lua_pushboolean (lua_State *L, int b) {
   lua_lock(L);
   if (b)
@@ -856,6 +876,7 @@ static void auxsetstr (lua_State *L, const TValue *t, const char *k) {
   int hres;
   TString *str = luaS_new(L, k);
   api_checkpop(L, 1);
+  luaV_watchset(L, str);
   luaV_fastset(t, str, s2v(L->top.p - 1), hres, luaH_psetstr);
   if (hres == HOK) {
     luaV_finishfastset(L, t, s2v(L->top.p - 1));
@@ -885,6 +906,8 @@ LUA_API void lua_settable (lua_State *L, int idx) {
   lua_lock(L);
   api_checkpop(L, 2);
   t = index2value(L, idx);
+  if (ttisstring(s2v(L->top.p - 2)))
+    luaV_watchset(L, tsvalue(s2v(L->top.p - 2)));
   luaV_fastset(t, s2v(L->top.p - 2), s2v(L->top.p - 1), hres, luaH_pset);
   if (hres == HOK) {
     luaV_finishfastset(L, t, s2v(L->top.p - 1));
@@ -926,6 +949,8 @@ static void aux_rawset (lua_State *L, int idx, TValue *key, int n) {
   lua_lock(L);
   api_checkpop(L, n);
   t = gettable(L, idx);
+  if (ttisstring(key))
+    luaV_watchset(L, tsvalue(key));
   luaH_set(L, t, key, s2v(L->top.p - 1));
   invalidateTMcache(t);
   luaC_barrierback(L, obj2gco(t), s2v(L->top.p - 1));
@@ -1058,24 +1083,15 @@ LUA_API void lua_callk (lua_State *L, int nargs, int nresults,
 
 
 /*
-** Execute a protected call.
+** Execute a protected call. With a continuation, the call does not
+** need its own protection when an enclosing one can recover it: that
+** is 'lua_resume' in yieldable coroutines and 'luaD_pcallrec' when
+** there are no non-yieldable calls after it. Otherwise, it does a
+** conventional protected call, which can recover inner ones.
 */
-struct CallS {  /* data to 'f_call' */
-  StkId func;
-  int nresults;
-};
-
-
-static void f_call (lua_State *L, void *ud) {
-  struct CallS *c = cast(struct CallS *, ud);
-  luaD_callnoyield(L, c->func, c->nresults);
-}
-
-
-
 LUA_API int lua_pcallk (lua_State *L, int nargs, int nresults, int errfunc,
                         lua_KContext ctx, lua_KFunction k) {
-  struct CallS c;
+  StkId f;
   int status;
   ptrdiff_t func;
   lua_lock(L);
@@ -1091,22 +1107,20 @@ LUA_API int lua_pcallk (lua_State *L, int nargs, int nresults, int errfunc,
     api_check(L, ttisfunction(s2v(o)), "error handler must be a function");
     func = savestack(L, o);
   }
-  c.func = L->top.p - (nargs+1);  /* function to be called */
-  if (k == NULL || !yieldable(L)) {  /* no continuation or no yieldable? */
-    c.nresults = nresults;  /* do a 'conventional' protected call */
-    status = luaD_pcall(L, f_call, &c, savestack(L, c.func), func);
-  }
-  else {  /* prepare continuation (call is already protected by 'resume') */
+  f = L->top.p - (nargs+1);  /* function to be called */
+  if (k == NULL || !(yieldable(L) || luaD_canrecover(L)))
+    status = luaD_pcallrec(L, f, nresults, func);  /* 'conventional' call */
+  else {  /* prepare continuation (call is already protected) */
     CallInfo *ci = L->ci;
     ci->u.c.k = k;  /* save continuation */
     ci->u.c.ctx = ctx;  /* save context */
     /* save information for error recovery */
-    ci->u2.funcidx = cast_int(savestack(L, c.func));
+    ci->u2.funcidx = cast_int(savestack(L, f));
     ci->u.c.old_errfunc = L->errfunc;
     L->errfunc = func;
     setoah(ci, L->allowhook);  /* save value of 'allowhook' */
     ci->callstatus |= CIST_YPCALL;  /* function can do error recovery */
-    luaD_call(L, c.func, nresults);  /* do the call */
+    luaD_call(L, f, nresults);  /* do the call */
     ci->callstatus &= ~CIST_YPCALL;
     L->errfunc = ci->u.c.old_errfunc;
     status = LUA_OK;  /* if it is here, there were no errors */
@@ -1235,6 +1249,50 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
         g->gcparams[param] = luaO_codeparam(cast_uint(value));
       break;
     }
+    case LUA_GCLIMIT: {
+      int limit = va_arg(argp, int);
+      l_mem old = (g->GClimit == MAX_LMEM) ? 0 : (g->GClimit >> 10);
+      res = (old > INT_MAX) ? INT_MAX : cast_int(old);
+      if (limit == 0)
+        g->GClimit = MAX_LMEM;  /* no limit */
+      else if (limit > 0)
+        g->GClimit = cast(l_mem, limit) << 10;
+      break;
+    }
+    case LUA_GCLIMITHITS: {
+      res = (g->GClimithits > INT_MAX) ? INT_MAX : cast_int(g->GClimithits);
+      break;
+    }
+    case LUA_GCDEFERFIN: {
+      int on = va_arg(argp, int);
+      res = g->gcdeferfin;
+      if (on >= 0)
+        g->gcdeferfin = (on != 0);
+      break;
+    }
+    case LUA_GCRUNFIN: {
+      int budget = va_arg(argp, int);
+      res = luaC_runfinalizers(L, budget);
+      break;
+    }
+    case LUA_GCTHREADPOOL: {
+      int size = va_arg(argp, int);
+      res = g->maxthreadpool;
+      if (size >= 0) {
+        g->maxthreadpool = size;
+        luaE_shrinkthreadpool(L);
+      }
+      break;
+    }
+    case LUA_GCTHREADHITS: {
+      res = (g->threadhits > INT_MAX) ? INT_MAX : cast_int(g->threadhits);
+      break;
+    }
+    case LUA_GCTHREADMISSES: {
+      res = (g->threadmisses > INT_MAX) ? INT_MAX
+                                        : cast_int(g->threadmisses);
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   va_end(argp);
@@ -1243,6 +1301,17 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
 }
 
 
+LUA_API int lua_runfinalizers (lua_State *L, int budget) {
+  int res;
+  if (G(L)->gcstp & (GCSTPGC | GCSTPCLS))  /* inside a finalizer? */
+    return 0;  /* cannot run other finalizers */
+  lua_lock(L);
+  res = luaC_runfinalizers(L, budget);
+  lua_unlock(L);
+  return res;
+}
+
+
 
 /*
 ** miscellaneous functions
@@ -732,6 +732,11 @@ typedef struct LoadF {
 } LoadF;
 
 
+static int cacheon (lua_State *L);
+static int loadcachedF (lua_State *L, LoadF *lf, const char *name,
+                                      const char *mode);
+
+
 static const char *getF (lua_State *L, void *ud, size_t *size) {
   LoadF *lf = (LoadF *)ud;
   (void)L;  /* not used */
@@ -827,7 +832,11 @@ LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
   }
   if (c != EOF)
     lf.buff[lf.n++] = cast_char(c);  /* 'c' is the first character */
-  status = lua_load(L, getF, &lf, lua_tostring(L, -1), mode);
+  if (c != LUA_SIGNATURE[0] && (mode == NULL || strchr(mode, 't') != NULL) &&
+      cacheon(L))  /* text that may be cached? */
+    status = loadcachedF(L, &lf, lua_tostring(L, -1), mode);
+  else
+    status = lua_load(L, getF, &lf, lua_tostring(L, -1), mode);
   readstatus = ferror(lf.f);
   errno = 0;  /* no useful error number until here */
   if (filename) fclose(lf.f);  /* close file (even in case of errors) */
@@ -856,15 +865,295 @@ static const char *getS (lua_State *L, void *ud, size_t *size) {
 }
 
 
+/*
+** {======================================================
+** Compiled-chunk cache
+** =======================================================
+*/
+
+/*
+** When the registry has a table in field CHUNKCACHE, text chunks
+** loaded by 'luaL_loadbufferx' and 'luaL_loadfilex' go through a cache
+** of precompiled chunks on disk. The file for a chunk is the table's
+** 'prefix' followed by a hash of the chunk (its source, its name, and
+** the configuration of Lua). Fields 'hits' and 'misses' count the
+** lookups, and field 'file' keeps the last file used. A cached file
+** that fails to load (e.g., truncated, or from another build of Lua)
+** is just a miss.
+*/
+#define CHUNKCACHE	"_CHUNKCACHE"
+
+
+static int cacheon (lua_State *L) {
+  int on = (lua_getfield(L, LUA_REGISTRYINDEX, CHUNKCACHE) == LUA_TTABLE);
+  lua_pop(L, 1);
+  return on;
+}
+
+
+/* FNV-1a */
+static unsigned long long hashbytes (unsigned long long h, const void *p,
+                                                           size_t l) {
+  const unsigned char *s = (const unsigned char *)p;
+  size_t i;
+  for (i = 0; i < l; i++)
+    h = (h ^ s[i]) * 0x100000001b3ULL;
+  return h;
+}
+
+
+static unsigned long long hashchunk (const char *s, size_t l,
+                                     const char *name) {
+  static const int config[] = {LUA_VERSION_NUM, (int)sizeof(lua_Integer),
+                       (int)sizeof(lua_Number), (int)sizeof(void *)};
+  unsigned long long h = 0xcbf29ce484222325ULL;
+  h = hashbytes(h, config, sizeof(config));
+  h = hashbytes(h, name, strlen(name) + 1);  /* name goes into the dump */
+  return hashbytes(h, s, l);
+}
+
+
+static int dumpwriter (lua_State *L, const void *b, size_t size, void *f) {
+  (void)L;  /* not used */
+  return (fwrite(b, size, 1, (FILE *)f) != 1 && size != 0);
+}
+
+
+/*
+** Temporary files are per process, so that processes filling the cache
+** at the same time do not write over each other.
+*/
+#if defined(LUA_USE_POSIX)
+#include <unistd.h>
+#define l_procid()	((int)getpid())
+#else
+#define l_procid()	0
+#endif
+
+
+/*
+** Save the function on the top of the stack in file 'path'. It writes
+** to a temporary file and renames it, so that readers never see a
+** partial file.
+*/
+static void savechunk (lua_State *L, const char *path) {
+  const char *tmp = lua_pushfstring(L, "%s.%d.tmp", path, l_procid());
+  FILE *f = fopen(tmp, "wb");
+  if (f != NULL) {
+    int err;
+    lua_pushvalue(L, -2);  /* function to be saved */
+    err = lua_dump(L, dumpwriter, f, 0);
+    lua_pop(L, 1);  /* remove function copy */
+    err = (fclose(f) != 0) || err;
+    if (err || rename(tmp, path) != 0)
+      remove(tmp);
+  }
+  lua_pop(L, 1);  /* remove 'tmp' */
+}
+
+
+static void countcache (lua_State *L, int ct, const char *field) {
+  lua_Integer n;
+  lua_getfield(L, ct, field);
+  n = lua_tointeger(L, -1);  /* (0 if absent) */
+  lua_pop(L, 1);
+  lua_pushinteger(L, n + 1);
+  lua_setfield(L, ct, field);
+}
+
+
+/*
+** Load text chunk 's' through the cache. Like 'lua_load', leaves the
+** function or an error message on the top of the stack.
+*/
+static int loadcached (lua_State *L, const char *s, size_t size,
+                                     const char *name, const char *mode) {
+  LoadS ls;
+  char hash[2 * sizeof(unsigned long long) + 1];
+  const char *path;
+  FILE *f;
+  int status = !LUA_OK;
+  int ct = lua_gettop(L) + 1;  /* index of cache table */
+  if (name == NULL) name = "?";  /* same default as 'lua_load' */
+  lua_getfield(L, LUA_REGISTRYINDEX, CHUNKCACHE);
+  snprintf(hash, sizeof(hash), "%016llx", hashchunk(s, size, name));
+  lua_getfield(L, ct, "prefix");
+  path = lua_pushfstring(L, "%s%s", lua_tostring(L, -1), hash);
+  lua_remove(L, -2);  /* remove prefix */
+  lua_pushvalue(L, -1);
+  lua_setfield(L, ct, "file");
+  f = fopen(path, "rb");
+  if (f != NULL) {  /* try cached chunk */
+    LoadF lf;
+    lf.n = 0;
+    lf.f = f;
+    status = lua_load(L, getF, &lf, name, "b");
+    fclose(f);
+    if (status != LUA_OK)
+      lua_pop(L, 1);  /* ignore error; do it the usual way */
+  }
+  if (status == LUA_OK)
+    countcache(L, ct, "hits");
+  else {  /* miss */
+    countcache(L, ct, "misses");
+    ls.s = s;
+    ls.size = size;
+    status = lua_load(L, getS, &ls, name, mode);
+    if (status == LUA_OK)
+      savechunk(L, path);
+  }
+  lua_replace(L, ct);  /* result replaces cache table */
+  lua_settop(L, ct);
+  return status;
+}
+
+
+/*
+** Read the rest of a text file and load it through the cache.
+*/
+static int loadcachedF (lua_State *L, LoadF *lf, const char *name,
+                                      const char *mode) {
+  luaL_Buffer b;
+  const char *s;
+  size_t size;
+  int status;
+  luaL_buffinit(L, &b);
+  while ((s = getF(L, lf, &size)) != NULL)
+    luaL_addlstring(&b, s, size);
+  luaL_pushresult(&b);
+  s = lua_tolstring(L, -1, &size);
+  status = loadcached(L, s, size, name, mode);
+  lua_remove(L, -2);  /* remove source */
+  return status;
+}
+
+
+LUALIB_API void luaL_setchunkcache (lua_State *L, const char *prefix) {
+  if (prefix == NULL)
+    lua_pushnil(L);
+  else {
+    lua_createtable(L, 0, 4);
+    lua_pushstring(L, prefix);
+    lua_setfield(L, -2, "prefix");
+  }
+  lua_setfield(L, LUA_REGISTRYINDEX, CHUNKCACHE);
+}
+
+/* }====================================================== */
+
+
 LUALIB_API int luaL_loadbufferx (lua_State *L, const char *buff, size_t size,
                                  const char *name, const char *mode) {
   LoadS ls;
+  if (size > 0 && buff[0] != LUA_SIGNATURE[0] &&  /* text chunk... */
+      (mode == NULL || strchr(mode, 't') != NULL) &&  /* ...allowed... */
+      cacheon(L))  /* ...and a cache? */
+    return loadcached(L, buff, size, name, mode);
   ls.s = buff;
   ls.size = size;
   return lua_load(L, getS, &ls, name, mode);
 }
 
 
+/*
+** {======================================================
+** Load precompiled chunks from memory-mapped files
+** =======================================================
+*/
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+
+/* registry key for the table anchoring all mappings of a state */
+static const char *const BCMAPS = "_BCMAPS";
+
+
+/*
+** A mapping is owned by an external string over its whole contents;
+** when that string is collected, the mapping goes away.
+*/
+static void *unmapchunk (void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud; (void)nsize;  /* not used */
+  munmap(ptr, osize);
+  return NULL;
+}
+
+
+/*
+** Map 'size' bytes from file 'fd' plus a final zero, which external
+** strings need. The file goes over an anonymous mapping one byte
+** larger, so that the zero exists even when 'size' is a multiple of
+** the page size.
+*/
+static char *mapchunk (int fd, size_t size) {
+  void *p = mmap(NULL, size + 1, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                                 -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+  if (mmap(p, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(p, size + 1);
+    return NULL;
+  }
+  return (char *)p;
+}
+
+
+/*
+** Load a precompiled chunk without copying it: the file is mapped
+** read-only and loaded in fixed mode, so code, line information, and
+** long strings stay in the mapping, shared by all processes mapping
+** the same file. The mapping lives until the state is closed. Files
+** that cannot be mapped (or that are too small to be worth it) are
+** loaded with 'luaL_loadfilex'.
+*/
+LUALIB_API int luaL_loadbytecodefile (lua_State *L, const char *filename) {
+  struct stat st;
+  char *chunk;
+  int status;
+  int fd = (filename == NULL) ? -1 : open(filename, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      st.st_size < 4096 || (chunk = mapchunk(fd, (size_t)st.st_size)) == NULL) {
+    if (fd >= 0) close(fd);
+    return luaL_loadfilex(L, filename, "b");  /* do it the usual way */
+  }
+  close(fd);  /* mapping does not need it */
+  if (chunk[0] != LUA_SIGNATURE[0]) {  /* not a binary chunk? */
+    munmap(chunk, (size_t)st.st_size + 1);
+    return luaL_loadfilex(L, filename, "b");  /* let it handle the error */
+  }
+  lua_pushextlstring(L, chunk, (size_t)st.st_size, unmapchunk, NULL);
+  lua_pushfstring(L, "@%s", filename);
+  status = luaL_loadbufferx(L, chunk, (size_t)st.st_size,
+                               lua_tostring(L, -1), "B");
+  lua_remove(L, -2);  /* remove chunk name */
+  if (status == LUA_OK) {  /* anchor mapping in the state */
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, BCMAPS);
+    lua_pushvalue(L, -3);  /* mapping */
+    lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+    lua_pop(L, 1);  /* remove table */
+  }
+  lua_remove(L, -2);  /* remove mapping (result is on the top) */
+  return status;
+}
+
+#else				/* }{ */
+
+LUALIB_API int luaL_loadbytecodefile (lua_State *L, const char *filename) {
+  return luaL_loadfilex(L, filename, "b");
+}
+
+#endif				/* } */
+/* }====================================================== */
+
+
 LUALIB_API int luaL_loadstring (lua_State *L, const char *s) {
   return luaL_loadbuffer(L, s, strlen(s), s);
 }
@@ -971,6 +1260,17 @@ LUALIB_API void luaL_setfuncs (lua_State *L, const luaL_Reg *l, int nup) {
 }
 
 
+/*
+** set leaf functions from list 'l' into table at top
+*/
+LUALIB_API void luaL_setleaves (lua_State *L, const luaL_Leaf *l) {
+  for (; l->name != NULL; l++) {  /* fill the table with given functions */
+    lua_pushleaf(L, l->func, l->nargs);
+    lua_setfield(L, -2, l->name);
+  }
+}
+
+
 /*
 ** ensure that stack[idx][fname] has a table and push that table
 ** into the stack
@@ -1179,6 +1479,416 @@ LUALIB_API lua_State *luaL_newstate (void) {
 }
 
 
+/*
+** {======================================================
+** Parallel compilation of chunks
+** =======================================================
+*/
+
+/* maximum number of threads compiling chunks at the same time */
+#if !defined(LUAL_MAXCOMPILERS)
+#define LUAL_MAXCOMPILERS	32
+#endif
+
+
+typedef struct CompileJob {
+  const char *buff;  /* text of the chunk */
+  size_t size;
+  const char *name;
+  const char *mode;
+  char *out;  /* dump of the compiled chunk, or error message */
+  size_t outsize;
+  size_t outcap;  /* allocated size of 'out' */
+  int status;
+} CompileJob;
+
+
+static int jobwriter (lua_State *L, const void *p, size_t sz, void *ud) {
+  CompileJob *job = (CompileJob *)ud;
+  (void)L;  /* not used */
+  if (sz > job->outcap - job->outsize) {
+    size_t newcap = (job->outcap == 0) ? 1024 : job->outcap;
+    char *newout;
+    while (sz > newcap - job->outsize)
+      newcap *= 2;
+    newout = (char *)realloc(job->out, newcap);
+    if (newout == NULL)
+      return 1;
+    job->out = newout;
+    job->outcap = newcap;
+  }
+  memcpy(job->out + job->outsize, p, sz);
+  job->outsize += sz;
+  return 0;
+}
+
+
+/*
+** Compile the chunk of a job and dump the result. Errors in the dump
+** are raised; errors in the compilation leave 'status' and the message.
+*/
+static int compilechunk (lua_State *L) {
+  CompileJob *job = (CompileJob *)lua_touserdata(L, 1);
+  job->status = luaL_loadbufferx(L, job->buff, job->size, job->name,
+                                    job->mode);
+  if (job->status == LUA_OK && lua_dump(L, jobwriter, job, 0) != 0)
+    luaL_error(L, "not enough memory");
+  return 1;
+}
+
+
+/*
+** Run a job in a new state, used only for it, so that its allocations
+** and its strings are not shared with any other thread. Only the dump
+** of the compiled chunk (or the error message) remains.
+*/
+static void runjob (CompileJob *job) {
+  lua_State *L = lua_newstate(l_alloc, NULL, luai_makeseed());
+  size_t l;
+  const char *msg;
+  if (L == NULL) {
+    job->status = LUA_ERRMEM;
+    return;
+  }
+  lua_atpanic(L, &panic);
+  lua_pushcfunction(L, compilechunk);
+  lua_pushlightuserdata(L, job);
+  if (lua_pcall(L, 1, 1, 0) != LUA_OK)
+    job->status = LUA_ERRMEM;  /* only memory errors can get here */
+  if (job->status != LUA_OK) {
+    msg = lua_tolstring(L, -1, &l);
+    job->outsize = 0;
+    if (msg == NULL || jobwriter(L, msg, l, job) != 0) {
+      job->outsize = 0;  /* keep no message */
+      job->status = LUA_ERRMEM;
+    }
+  }
+  lua_close(L);
+}
+
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <pthread.h>
+#include <unistd.h>
+
+
+typedef struct JobQueue {
+  CompileJob *jobs;
+  int n;
+  int next;  /* next job to be taken */
+  pthread_mutex_t lock;
+} JobQueue;
+
+
+static void *compileworker (void *ud) {
+  JobQueue *q = (JobQueue *)ud;
+  for (;;) {
+    int i;
+    pthread_mutex_lock(&q->lock);
+    i = q->next++;
+    pthread_mutex_unlock(&q->lock);
+    if (i >= q->n)
+      return NULL;
+    runjob(&q->jobs[i]);
+  }
+}
+
+
+/*
+** Run all jobs, on as many threads as there are processors (the
+** calling thread is one of them).
+*/
+static void runjobs (CompileJob *jobs, int n) {
+  pthread_t threads[LUAL_MAXCOMPILERS];
+  JobQueue q;
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int nthreads = (ncpu < 1) ? 1 : (ncpu > n) ? n : (int)ncpu;
+  int i, created = 0;
+  if (nthreads > LUAL_MAXCOMPILERS)
+    nthreads = LUAL_MAXCOMPILERS;
+  q.jobs = jobs; q.n = n; q.next = 0;
+  pthread_mutex_init(&q.lock, NULL);
+  for (i = 1; i < nthreads; i++) {
+    if (pthread_create(&threads[created], NULL, compileworker, &q) == 0)
+      created++;
+  }
+  compileworker(&q);
+  for (i = 0; i < created; i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&q.lock);
+}
+
+#else				/* }{ */
+
+static void runjobs (CompileJob *jobs, int n) {
+  int i;
+  for (i = 0; i < n; i++)
+    runjob(&jobs[i]);
+}
+
+#endif				/* } */
+
+
+typedef struct JobList {
+  int n;
+  CompileJob *jobs;
+} JobList;
+
+
+/*
+** Release the results not yet loaded, when the list of jobs is
+** collected (normally or after an error).
+*/
+static int jobsgc (lua_State *L) {
+  JobList *jl = (JobList *)lua_touserdata(L, 1);
+  if (jl->jobs != NULL) {
+    int i;
+    for (i = 0; i < jl->n; i++)
+      free(jl->jobs[i].out);
+    free(jl->jobs);
+    jl->jobs = NULL;
+  }
+  return 0;
+}
+
+
+static CompileJob *newjobs (lua_State *L, int n) {
+  JobList *jl = (JobList *)lua_newuserdatauv(L, sizeof(JobList), 0);
+  jl->n = 0;
+  jl->jobs = NULL;
+  if (luaL_newmetatable(L, "_LOADJOBS")) {
+    lua_pushcfunction(L, jobsgc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  jl->jobs = (CompileJob *)malloc((n > 0 ? n : 1) * sizeof(CompileJob));
+  if (jl->jobs == NULL)
+    luaL_error(L, "not enough memory");
+  jl->n = n;
+  memset(jl->jobs, 0, (n > 0 ? n : 1) * sizeof(CompileJob));
+  return jl->jobs;
+}
+
+
+/*
+** Load 'n' chunks, compiling their texts in parallel. Each one is
+** compiled in a separate state by a worker thread; the owning thread
+** then loads the dumps of the results, in order, so that their
+** strings go to 'L'. Pushes, for each chunk, its function or the
+** error message. Returns the number of chunks with errors and, if
+** 'status' is not NULL, the result of each load in it. Binary chunks
+** are loaded directly. This function does not use the compiled-chunk
+** cache.
+*/
+LUALIB_API int luaL_loadbuffers (lua_State *L, int n,
+                                 const char *const *buffs,
+                                 const size_t *sizes,
+                                 const char *const *names,
+                                 const char *mode, int *status) {
+  CompileJob *jobs;
+  int i, ntext = 0, nerrors = 0;
+  luaL_checkstack(L, n + 2, "too many chunks");
+  jobs = newjobs(L, n);
+  for (i = 0; i < n; i++) {
+    CompileJob *job = &jobs[ntext];
+    if (sizes[i] > 0 && buffs[i][0] == LUA_SIGNATURE[0])
+      continue;  /* binary chunk */
+    job->buff = buffs[i]; job->size = sizes[i];
+    job->name = names[i]; job->mode = mode;
+    ntext++;
+  }
+  runjobs(jobs, ntext);
+  for (i = 0, ntext = 0; i < n; i++) {
+    int st;
+    if (sizes[i] > 0 && buffs[i][0] == LUA_SIGNATURE[0])
+      st = luaL_loadbufferx(L, buffs[i], sizes[i], names[i], mode);
+    else {
+      CompileJob *job = &jobs[ntext++];
+      st = job->status;
+      if (st == LUA_OK)
+        st = luaL_loadbufferx(L, job->out, job->outsize, names[i], "b");
+      else if (job->outsize > 0)
+        lua_pushlstring(L, job->out, job->outsize);
+      else
+        lua_pushliteral(L, "not enough memory");
+      free(job->out);
+      job->out = NULL;
+    }
+    if (st != LUA_OK)
+      nerrors++;
+    if (status != NULL)
+      status[i] = st;
+    lua_insert(L, -2);  /* keep the jobs on the top */
+  }
+  lua_pop(L, 1);  /* remove jobs (collected later) */
+  return nerrors;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Prototypes shared among states
+** =======================================================
+*/
+
+/*
+** A shared chunk is the dump of a function, in the lazy format, kept
+** in memory that belongs to no state and that is never changed. Each
+** state loads it in fixed mode: code, line information, long strings,
+** and the bodies of nested functions stay in the shared memory, and
+** the state builds only the prototypes it actually uses, with their
+** constants and its own copies of short strings (which must be
+** internalized in each state). For the collector, those shared parts
+** are external: it never frees or traverses them. The chunk is
+** reference counted: its creator holds one reference, and each state
+** that loaded it holds another until it is closed.
+*/
+struct luaL_SharedChunk {
+  char *data;  /* the dump plus a final zero (for external strings) */
+  size_t size;  /* size of the dump */
+  size_t cap;  /* allocated size of 'data' */
+  int refs;  /* number of references */
+};
+
+
+/* registry key for the table anchoring the shared chunks of a state */
+static const char *const SHAREDCHUNKS = "_SHAREDCHUNKS";
+
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <pthread.h>
+
+static pthread_mutex_t sharelock = PTHREAD_MUTEX_INITIALIZER;
+#define lockshared()	pthread_mutex_lock(&sharelock)
+#define unlockshared()	pthread_mutex_unlock(&sharelock)
+
+#else				/* }{ */
+
+#define lockshared()	((void)0)
+#define unlockshared()	((void)0)
+
+#endif				/* } */
+
+
+static void releaseshared (luaL_SharedChunk *sc) {
+  int refs;
+  lockshared();
+  refs = --sc->refs;
+  unlockshared();
+  if (refs == 0) {
+    free(sc->data);
+    free(sc);
+  }
+}
+
+
+/*
+** A state references a shared chunk through an external string over
+** the dump; when that string is collected, the reference goes away.
+*/
+static void *unshare (void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ptr; (void)osize; (void)nsize;  /* not used */
+  releaseshared((luaL_SharedChunk *)ud);
+  return NULL;
+}
+
+
+static int sharewriter (lua_State *L, const void *p, size_t sz, void *ud) {
+  luaL_SharedChunk *sc = (luaL_SharedChunk *)ud;
+  (void)L;  /* not used */
+  if (sc->cap - sc->size < sz) {  /* not enough space? */
+    size_t newcap = (sc->cap > 0) ? sc->cap * 2 : 1024;
+    char *newdata;
+    while (newcap - sc->size < sz)
+      newcap *= 2;
+    newdata = (char *)realloc(sc->data, newcap);
+    if (newdata == NULL)
+      return 1;
+    sc->data = newdata;
+    sc->cap = newcap;
+  }
+  memcpy(sc->data + sc->size, p, sz);
+  sc->size += sz;
+  return 0;
+}
+
+
+/*
+** Dump function at index 1 into the shared chunk at index 2. (Dumping
+** can raise errors, as it may have to compile lazy functions.)
+*/
+static int dumpshared (lua_State *L) {
+  luaL_SharedChunk *sc = (luaL_SharedChunk *)lua_touserdata(L, 2);
+  lua_settop(L, 1);  /* function must be on the top */
+  if (lua_dump(L, sharewriter, sc, LUA_DUMPLAZY) != 0 ||
+      sharewriter(L, "", 1, sc) != 0)  /* add final zero */
+    return luaL_error(L, "not enough memory");
+  sc->size--;  /* final zero is not part of the dump */
+  return 0;
+}
+
+
+/*
+** Create a shared chunk with the Lua function at index 'idx'. The
+** caller owns the new chunk and must release it with
+** 'luaL_releaseshared' when it does not need it anymore; states that
+** loaded it keep it alive.
+*/
+LUALIB_API luaL_SharedChunk *luaL_newshared (lua_State *L, int idx) {
+  luaL_SharedChunk *sc;
+  idx = lua_absindex(L, idx);
+  luaL_argexpected(L, lua_type(L, idx) == LUA_TFUNCTION &&
+                      !lua_iscfunction(L, idx), idx, "Lua function");
+  sc = (luaL_SharedChunk *)malloc(sizeof(luaL_SharedChunk));
+  if (sc == NULL)
+    luaL_error(L, "not enough memory");
+  sc->data = NULL;
+  sc->size = sc->cap = 0;
+  sc->refs = 1;
+  lua_pushcfunction(L, dumpshared);
+  lua_pushvalue(L, idx);
+  lua_pushlightuserdata(L, sc);
+  if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+    releaseshared(sc);
+    lua_error(L);  /* propagate error */
+  }
+  return sc;
+}
+
+
+/*
+** Load a shared chunk into 'L'. The first load in a state anchors a
+** reference to the chunk in that state; all loads share its memory.
+*/
+LUALIB_API int luaL_loadshared (lua_State *L, luaL_SharedChunk *sc,
+                                const char *name) {
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, SHAREDCHUNKS);
+  if (lua_rawgetp(L, -1, sc) == LUA_TNIL) {  /* first load in this state? */
+    lua_pop(L, 1);  /* remove nil */
+    lua_pushextlstring(L, sc->data, sc->size, unshare, sc);
+    lockshared();
+    sc->refs++;  /* string now holds a reference */
+    unlockshared();
+    lua_rawsetp(L, -2, sc);
+  }
+  else
+    lua_pop(L, 1);  /* remove previous anchor */
+  lua_pop(L, 1);  /* remove table */
+  return luaL_loadbufferx(L, sc->data, sc->size, name, "B");
+}
+
+
+LUALIB_API void luaL_releaseshared (luaL_SharedChunk *sc) {
+  releaseshared(sc);
+}
+
+/* }====================================================== */
+
+
 LUALIB_API void luaL_checkversion_ (lua_State *L, lua_Number ver, size_t sz) {
   lua_Number v = lua_version(L);
   if (sz != LUAL_NUMSIZES)  /* check numeric types */
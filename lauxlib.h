@@ -41,6 +41,14 @@ typedef struct luaL_Reg {
 } luaL_Reg;
 
 
+/* a leaf C function (see 'lua_pushleaf') and its number of arguments */
+typedef struct luaL_Leaf {
+  const char *name;
+  lua_CFunction func;
+  int nargs;
+} luaL_Leaf;
+
+
 constexpr inline int LUAL_NUMSIZES = (sizeof(lua_Integer) * 16 + sizeof(lua_Number));
 
 LUALIB_API void (luaL_checkversion_) (lua_State *L, lua_Number ver, size_t sz);
@@ -97,6 +105,21 @@ LUA_INL int luaL_loadfile(lua_State* L,const char* filename) { return luaL_loadf
 
 LUALIB_API int (luaL_loadbufferx) (lua_State *L, const char *buff, size_t sz,
                                    const char *name, const char *mode);
+LUALIB_API int (luaL_loadbytecodefile) (lua_State *L, const char *filename);
+LUALIB_API void (luaL_setchunkcache) (lua_State *L, const char *prefix);
+LUALIB_API int (luaL_loadbuffers) (lua_State *L, int n,
+                                   const char *const *buffs,
+                                   const size_t *sizes,
+                                   const char *const *names,
+                                   const char *mode, int *status);
+
+typedef struct luaL_SharedChunk luaL_SharedChunk;
+
+LUALIB_API luaL_SharedChunk *(luaL_newshared) (lua_State *L, int idx);
+LUALIB_API int (luaL_loadshared) (lua_State *L, luaL_SharedChunk *sc,
+                                  const char *name);
+LUALIB_API void (luaL_releaseshared) (luaL_SharedChunk *sc);
+
 LUALIB_API int (luaL_loadstring)  (lua_State *L, const char *s);
 
 LUALIB_API lua_State *(luaL_newstate) (void);
@@ -111,6 +134,7 @@ LUALIB_API const char *(luaL_gsub) (lua_State *L, const char *s,
                                     const char *p, const char *r);
 
 LUALIB_API void (luaL_setfuncs) (lua_State *L, const luaL_Reg *l, int nup);
+LUALIB_API void (luaL_setleaves) (lua_State *L, const luaL_Leaf *l);
 
 LUALIB_API int (luaL_getsubtable) (lua_State *L, int idx, const char *fname);
 
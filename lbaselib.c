@@ -203,12 +203,21 @@ static int pushmode (lua_State *L, int oldmode) {
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "isrunning", "generational", "incremental",
-    "param", NULL};
+    "param", "limit", "limithits", "deferfinalizers", "runfinalizers",
+    "threadpool", "threadhits", "threadmisses", NULL};
   static const char optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC,
-    LUA_GCPARAM};
+    LUA_GCPARAM, LUA_GCLIMIT, LUA_GCLIMITHITS, LUA_GCDEFERFIN, LUA_GCRUNFIN,
+    LUA_GCTHREADPOOL, LUA_GCTHREADHITS, LUA_GCTHREADMISSES};
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
   switch (o) {
+    case LUA_GCRUNFIN: case LUA_GCTHREADPOOL: {
+      lua_Integer n = luaL_optinteger(L, 2, -1);
+      int res = lua_gc(L, o, (int)n);
+      checkvalres(res);
+      lua_pushinteger(L, res);
+      return 1;
+    }
     case LUA_GCCOUNT: {
       int k = lua_gc(L, o);
       int b = lua_gc(L, LUA_GCCOUNTB);
@@ -247,6 +256,19 @@ static int luaB_collectgarbage (lua_State *L) {
       lua_pushinteger(L, lua_gc(L, o, p, (int)value));
       return 1;
     }
+    case LUA_GCLIMIT: {
+      lua_Integer limit = luaL_optinteger(L, 2, -1);
+      int res = lua_gc(L, o, (int)limit);
+      checkvalres(res);
+      lua_pushinteger(L, res);
+      return 1;
+    }
+    case LUA_GCDEFERFIN: {
+      int res = lua_gc(L, o, lua_isnone(L, 2) ? -1 : lua_toboolean(L, 2));
+      checkvalres(res);
+      lua_pushboolean(L, res);
+      return 1;
+    }
     default: {
       int res = lua_gc(L, o);
       checkvalres(res);
@@ -362,13 +384,20 @@ static const char *getMode (lua_State *L, int idx) {
 }
 
 
+/*
+** Mode "B" maps a precompiled file into memory (see
+** 'luaL_loadbytecodefile'); the state owns the mapping, so it is safe
+** for Lua code.
+*/
 static int luaB_loadfile (lua_State *L) {
   const char *fname = luaL_optstring(L, 1, NULL);
-  const char *mode = getMode(L, 2);
+  int mapped = (strcmp(luaL_optstring(L, 2, "bt"), "B") == 0);
+  const char *mode = mapped ? "B" : getMode(L, 2);
   
   int env = (!lua_isnone(L, 3) ? 3 : 0);  /* 'env' index or 0 if no 'env' */
   
-  int status = luaL_loadfilex(L, fname, mode);
+  int status = mapped ? luaL_loadbytecodefile(L, fname)
+                      : luaL_loadfilex(L, fname, mode);
   return load_aux(L, status, env);
 }
 #endif
@@ -567,15 +596,10 @@ static const luaL_Reg base_funcs[] = {
   {"pcall", luaB_pcall},
   {"print", luaB_print},
   {"warn", luaB_warn},
-  {"rawequal", luaB_rawequal},
-  {"rawlen", luaB_rawlen},
-  {"rawget", luaB_rawget},
-  {"rawset", luaB_rawset},
   {"select", luaB_select},
   {"setmetatable", luaB_setmetatable},
   {"tonumber", luaB_tonumber},
   {"tostring", luaB_tostring},
-  {"type", luaB_type},
   {"xpcall", luaB_xpcall},
   /* placeholders */
   {LUA_GNAME, NULL},
@@ -584,10 +608,24 @@ static const luaL_Reg base_funcs[] = {
 };
 
 
+/*
+** functions called directly by the interpreter (see 'lua_pushleaf')
+*/
+static const luaL_Leaf base_leaves[] = {
+  {"rawequal", luaB_rawequal, 2},
+  {"rawlen", luaB_rawlen, 1},
+  {"rawget", luaB_rawget, 2},
+  {"rawset", luaB_rawset, 3},
+  {"type", luaB_type, 1},
+  {NULL, NULL, 0}
+};
+
+
 LUAMOD_API int luaopen_base (lua_State *L) {
   /* open lib into global table */
   lua_pushglobaltable(L);
   luaL_setfuncs(L, base_funcs, 0);
+  luaL_setleaves(L, base_leaves);
   /* set global _G */
   lua_pushvalue(L, -1);
   lua_setfield(L, -2, LUA_GNAME);
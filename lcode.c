@@ -14,6 +14,7 @@
 #include <limits.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -36,6 +37,7 @@
 
 
 static int codesJ (FuncState *fs, OpCode o, int sj, int k);
+static void checkaftercall (FuncState *fs, expdesc *e);
 
 
 
@@ -725,8 +727,11 @@ static void const2exp (TValue *v, expdesc *e) {
 void luaK_setreturns (FuncState *fs, expdesc *e, int nresults) {
   Instruction *pc = &getinstruction(fs, e);
   luaY_checklimit(fs, nresults + 1, MAXARG_C, "multiple results");
-  if (e->k == VCALL)  /* expression is an open function call? */
+  if (e->k == VCALL) {  /* expression is an open function call? */
     SETARG_C(*pc, nresults + 1);
+    if (nresults != LUA_MULTRET)
+      checkaftercall(fs, e);
+  }
   else {
     lua_assert(e->k == VVARARG);
     SETARG_C(*pc, nresults + 1);
@@ -760,6 +765,7 @@ void luaK_setoneret (FuncState *fs, expdesc *e) {
   if (e->k == VCALL) {  /* expression is an open function call? */
     /* already returns 1 value */
     lua_assert(GETARG_C(getinstruction(fs, e)) == 2);
+    checkaftercall(fs, e);
     e->k = VNONRELOC;  /* result has fixed position */
     e->u.info = GETARG_A(getinstruction(fs, e));
   }
@@ -818,6 +824,10 @@ void luaK_dischargevars (FuncState *fs, expdesc *e) {
       luaK_setoneret(fs, e);
       break;
     }
+    case VINLINE: {  /* result already in its register */
+      e->k = VNONRELOC;
+      break;
+    }
     default: break;  /* there is one value available (somewhere) */
   }
 }
@@ -1880,3 +1890,1002 @@ void luaK_finish (FuncState *fs) {
     }
   }
 }
+
+
+/*
+** {======================================================
+** Optimizer: an optional pass over the finished code of a function,
+** working on its control-flow graph. It removes unreachable code,
+** jumps to the next instruction, and stores into temporary registers
+** that are never read (using a liveness analysis); it also replaces
+** jumps to returns by the returns themselves and, inside a basic
+** block, repeated reads of the same global by a move.
+** =======================================================
+*/
+
+/* marks for instructions */
+#define OREACH		1	/* instruction is reachable */
+#define OLEADER		2	/* instruction starts a basic block */
+#define ODEAD		4	/* instruction is to be removed */
+
+#define iskept(m)	(((m) & (OREACH | ODEAD)) == OREACH)
+
+
+/* sets of registers */
+#define RSETWORDS	((MAX_FSTACK + 32) / 32)
+typedef unsigned int RegSet[RSETWORDS];
+
+#define rsetadd(s,r)	((s)[(r) / 32] |= 1u << ((r) % 32))
+#define rsetdel(s,r)	((s)[(r) / 32] &= ~(1u << ((r) % 32)))
+#define rsethas(s,r)	(((s)[(r) / 32] >> ((r) % 32)) & 1u)
+
+
+typedef struct OptState {
+  Proto *f;
+  int n;  /* number of instructions */
+  lu_byte *mark;  /* marks for each instruction */
+  int *lines;  /* absolute line of each instruction */
+  int *aux;  /* auxiliary array, with 'n + 1' entries */
+  RegSet *live;  /* registers live at the entry of each instruction */
+} OptState;
+
+
+/*
+** Whether instruction at 'pc' may skip the next one: tests (which
+** skip their jump), OP_LFALSESKIP, and operators followed by their
+** metamethod fallbacks.
+*/
+static int isskip (OptState *os, int pc) {
+  OpCode op = GET_OPCODE(os->f->code[pc]);
+  return (testTMode(op) || op == OP_LFALSESKIP ||
+          (pc + 1 < os->n && testMMMode(GET_OPCODE(os->f->code[pc + 1]))));
+}
+
+
+/*
+** Collect in 's' the possible successors of instruction 'pc' and
+** return their number. Loop preparations also count their loop
+** instructions, so that these are kept when the body never ends
+** normally.
+*/
+static int successors (OptState *os, int pc, int s[3]) {
+  Instruction i = os->f->code[pc];
+  int ns = 0;
+  switch (GET_OPCODE(i)) {
+    case OP_JMP:
+      s[0] = pc + 1 + GETARG_sJ(i);
+      return 1;
+    case OP_RETURN: case OP_RETURN0: case OP_RETURN1:
+      return 0;
+    case OP_TFORPREP:
+      s[0] = pc + 1 + GETARG_Bx(i);
+      return 1;
+    case OP_FORPREP:
+      s[ns++] = pc + 1 + GETARG_Bx(i);  /* loop instruction */
+      s[ns++] = pc + 2 + GETARG_Bx(i);  /* after the loop */
+      break;
+    case OP_FORLOOP: case OP_TFORLOOP:
+      s[ns++] = pc + 1 - GETARG_Bx(i);
+      break;
+    case OP_HOISTCHECK:
+      s[ns++] = pc + 1 + GETARG_sBx(i);
+      break;
+    default:
+      if (isskip(os, pc))
+        s[ns++] = pc + 2;
+      break;
+  }
+  if (pc + 1 < os->n)
+    s[ns++] = pc + 1;
+  return ns;
+}
+
+
+/*
+** Compute the absolute line of each instruction from the line
+** information of the function (see 'savelineinfo').
+*/
+static void getlines (FuncState *fs, OptState *os) {
+  Proto *f = os->f;
+  int line = f->linedefined;
+  int nabs = 0;
+  int pc;
+  for (pc = 0; pc < os->n; pc++) {
+    if (f->lineinfo[pc] == ABSLINEINFO)
+      line = f->abslineinfo[nabs++].line;
+    else
+      line += f->lineinfo[pc];
+    os->lines[pc] = line;
+  }
+  lua_assert(nabs == fs->nabslineinfo);
+}
+
+
+/*
+** Change jumps to returns (not after tests) into the returns
+** themselves. (Returns that must close upvalues or correct a vararg
+** frame are OP_RETURN after 'luaK_finish', so they are not copied.)
+*/
+static void jumpstoreturns (OptState *os) {
+  Instruction *code = os->f->code;
+  int pc;
+  for (pc = 0; pc < os->n; pc++) {
+    if (GET_OPCODE(code[pc]) == OP_JMP &&
+        !(pc > 0 && testTMode(GET_OPCODE(code[pc - 1])))) {
+      Instruction t = code[pc + 1 + GETARG_sJ(code[pc])];
+      if (GET_OPCODE(t) == OP_RETURN0 || GET_OPCODE(t) == OP_RETURN1)
+        code[pc] = t;
+    }
+  }
+}
+
+
+/*
+** Mark reachable instructions and the leaders of basic blocks.
+** ('aux' is used as the stack of instructions to visit.)
+*/
+static void buildcfg (OptState *os) {
+  int *stack = os->aux;
+  int top = 0;
+  int pc;
+  memset(os->mark, 0, cast_sizet(os->n));
+  os->mark[0] = OREACH | OLEADER;
+  stack[top++] = 0;
+  while (top > 0) {
+    int s[3];
+    int ns, k;
+    pc = stack[--top];
+    ns = successors(os, pc, s);
+    for (k = 0; k < ns; k++) {
+      lua_assert(0 <= s[k] && s[k] < os->n);
+      if (!(ns == 1 && s[k] == pc + 1)) {  /* not a plain fall through? */
+        os->mark[s[k]] |= OLEADER;
+        if (pc + 1 < os->n)
+          os->mark[pc + 1] |= OLEADER;
+      }
+      if (!(os->mark[s[k]] & OREACH)) {
+        os->mark[s[k]] |= OREACH;
+        stack[top++] = s[k];
+      }
+    }
+  }
+}
+
+
+/*
+** Registers whose writes are tracked by 'reuseglobals': instructions
+** that cannot run any code (no metamethods except those of the
+** environment's '__index', no allocations) return how many registers
+** they set, starting at R[A]; other instructions return -1.
+*/
+static int puredefs (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK:
+    case OP_LOADKX: case OP_LOADFALSE: case OP_LOADTRUE:
+    case OP_GETUPVAL: case OP_GETTABUP:
+      return 1;
+    case OP_LOADNIL:
+      return GETARG_B(i) + 1;
+    case OP_EXTRAARG:
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+
+/*
+** Inside each basic block, when a global is read again and the
+** register with its first read was not changed, and nothing that can
+** change the global ran in between, replace the second read by a move.
+*/
+#define MAXAVAIL	8
+
+static void reuseglobals (OptState *os) {
+  Instruction *code = os->f->code;
+  struct { int reg; int key; } av[MAXAVAIL];  /* available reads */
+  int nav = 0;
+  int pc;
+  for (pc = 0; pc < os->n; pc++) {
+    Instruction i = code[pc];
+    int a = GETARG_A(i);
+    int nd = puredefs(i);
+    int k, found = -1;
+    if ((os->mark[pc] & OLEADER) || nd < 0) {
+      nav = 0;  /* forget everything */
+      if (nd < 0) continue;
+    }
+    if (GET_OPCODE(i) == OP_GETTABUP) {
+      int key = GETARG_B(i) * (MAXARG_C + 1) + GETARG_C(i);
+      for (k = 0; k < nav; k++)
+        if (av[k].key == key) found = av[k].reg;
+      if (found == a)  /* register already has that value? */
+        os->mark[pc] |= ODEAD;
+      else if (found >= 0)
+        code[pc] = CREATE_ABCk(OP_MOVE, a, found, 0, 0);
+      for (k = 0; k < nav; ) {  /* remove reads lost by this write */
+        if (av[k].reg == a) av[k] = av[--nav];
+        else k++;
+      }
+      if (nav < MAXAVAIL) {
+        av[nav].reg = a; av[nav++].key = key;
+      }
+    }
+    else {
+      for (k = 0; k < nav; ) {  /* remove reads lost by these writes */
+        if (a <= av[k].reg && av[k].reg < a + nd) av[k] = av[--nav];
+        else k++;
+      }
+    }
+  }
+}
+
+
+/*
+** Set in 'use' the registers that instruction 'i' may read, and in
+** 'def' the registers that it surely writes. Unknown cases use all
+** registers.
+*/
+static void usedef (Instruction i, RegSet use, RegSet def) {
+  int a = GETARG_A(i);
+  memset(use, 0, sizeof(RegSet));
+  memset(def, 0, sizeof(RegSet));
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN:
+    case OP_GETI: case OP_GETFIELD: case OP_ADDI: case OP_ADDK:
+    case OP_SUBK: case OP_MULK: case OP_MODK: case OP_POWK: case OP_DIVK:
+    case OP_IDIVK: case OP_BANDK: case OP_BORK: case OP_BXORK:
+    case OP_SHRI: case OP_SHLI:
+      rsetadd(use, GETARG_B(i));
+      rsetadd(def, a);
+      break;
+    case OP_GETTABLE: case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
+    case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR:
+    case OP_BXOR: case OP_SHL: case OP_SHR:
+      rsetadd(use, GETARG_B(i));
+      rsetadd(use, GETARG_C(i));
+      rsetadd(def, a);
+      break;
+    case OP_LOADI: case OP_LOADF: case OP_LOADK: case OP_LOADKX:
+    case OP_LOADFALSE: case OP_LFALSESKIP: case OP_LOADTRUE:
+    case OP_GETUPVAL: case OP_GETTABUP: case OP_NEWTABLE:
+      rsetadd(def, a);
+      break;
+    case OP_LOADNIL: {
+      int r;
+      for (r = a; r <= a + GETARG_B(i); r++)
+        rsetadd(def, r);
+      break;
+    }
+    case OP_SETTABUP:
+      if (!GETARG_k(i)) rsetadd(use, GETARG_C(i));
+      break;
+    case OP_SETTABLE:
+      rsetadd(use, GETARG_B(i));
+    /* FALLTHROUGH */
+    case OP_SETI: case OP_SETFIELD:
+      rsetadd(use, a);
+      if (!GETARG_k(i)) rsetadd(use, GETARG_C(i));
+      break;
+    case OP_SELF:
+      rsetadd(use, GETARG_B(i));
+      if (!GETARG_k(i)) rsetadd(use, GETARG_C(i));
+      rsetadd(def, a);
+      rsetadd(def, a + 1);
+      break;
+    case OP_MMBIN: case OP_EQ: case OP_LT: case OP_LE:
+      rsetadd(use, a);
+      rsetadd(use, GETARG_B(i));
+      break;
+    case OP_TESTSET:
+      rsetadd(use, GETARG_B(i));
+      break;
+    case OP_SETUPVAL: case OP_MMBINI: case OP_MMBINK: case OP_EQK:
+    case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+    case OP_TEST: case OP_RETURN1:
+      rsetadd(use, a);
+      break;
+    case OP_JMP: case OP_RETURN0: case OP_EXTRAARG:
+      break;
+    default:  /* calls, returns, loops, closures, etc. */
+      memset(use, 0xff, sizeof(RegSet));
+      break;
+  }
+}
+
+
+/*
+** Compute the registers live at the entry of each reachable
+** instruction, iterating until a fixed point. Registers of named
+** local variables are always live, as they are visible to the debug
+** interface. ('aux' has the number of active variables at each
+** instruction.)
+*/
+static void liveness (OptState *os) {
+  int changed;
+  do {
+    int pc;
+    changed = 0;
+    for (pc = os->n - 1; pc >= 0; pc--) {
+      if (os->mark[pc] & OREACH) {
+        RegSet use, def, in;
+        int s[3];
+        int ns = successors(os, pc, s);
+        int k, w;
+        memset(in, 0, sizeof(RegSet));
+        for (k = 0; k < ns; k++)
+          for (w = 0; w < RSETWORDS; w++)
+            in[w] |= os->live[s[k]][w];
+        usedef(os->f->code[pc], use, def);
+        for (w = 0; w < RSETWORDS; w++)
+          in[w] = (in[w] & ~def[w]) | use[w];
+        for (k = 0; k < os->aux[pc]; k++)
+          rsetadd(in, k);
+        if (memcmp(in, os->live[pc], sizeof(RegSet)) != 0) {
+          memcpy(os->live[pc], in, sizeof(RegSet));
+          changed = 1;
+        }
+      }
+    }
+  } while (changed);
+}
+
+
+/*
+** Remove instructions that only write a register that is not live
+** after them.
+*/
+static void deadstores (OptState *os) {
+  Instruction *code = os->f->code;
+  int pc;
+  for (pc = 0; pc < os->n; pc++) {
+    Instruction i = code[pc];
+    if (!iskept(os->mark[pc]) || (pc > 0 && isskip(os, pc - 1)))
+      continue;
+    switch (GET_OPCODE(i)) {
+      case OP_LOADNIL:
+        if (GETARG_B(i) != 0) break;
+      /* FALLTHROUGH */
+      case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK:
+      case OP_LOADFALSE: case OP_LOADTRUE: case OP_GETUPVAL: {
+        int s[3];
+        int ns = successors(os, pc, s);
+        int k, live = 0;
+        for (k = 0; k < ns; k++)
+          live |= rsethas(os->live[s[k]], GETARG_A(i));
+        if (!live || (GET_OPCODE(i) == OP_MOVE && GETARG_B(i) == GETARG_A(i)))
+          os->mark[pc] |= ODEAD;
+        break;
+      }
+      default: break;
+    }
+  }
+}
+
+
+/*
+** Return the first kept instruction at or after 'pc'.
+*/
+static int nextkept (OptState *os, int pc) {
+  while (pc < os->n && !iskept(os->mark[pc]))
+    pc++;
+  return pc;
+}
+
+
+/*
+** Remove jumps to the next kept instruction (except those after
+** tests, which are part of the tests).
+*/
+static void jumpstonext (OptState *os) {
+  Instruction *code = os->f->code;
+  int changed;
+  do {
+    int pc;
+    changed = 0;
+    for (pc = 0; pc < os->n; pc++) {
+      if (iskept(os->mark[pc]) && GET_OPCODE(code[pc]) == OP_JMP &&
+          !(pc > 0 && testTMode(GET_OPCODE(code[pc - 1])))) {
+        int target = pc + 1 + GETARG_sJ(code[pc]);
+        if (target > pc && nextkept(os, target) == nextkept(os, pc + 1)) {
+          os->mark[pc] |= ODEAD;
+          changed = 1;
+        }
+      }
+    }
+  } while (changed);
+}
+
+
+/*
+** Remove the instructions not kept, correcting jumps, the ranges of
+** local variables, and line information.
+*/
+static void compact (FuncState *fs, OptState *os) {
+  Proto *f = os->f;
+  int *newpc = os->aux;
+  int pc, nk = 0;
+  for (pc = 0; pc < os->n; pc++) {
+    newpc[pc] = nk;
+    if (iskept(os->mark[pc])) nk++;
+  }
+  newpc[os->n] = nk;
+  for (pc = 0; pc < os->n; pc++) {
+    Instruction i = f->code[pc];
+    int np = newpc[pc];
+    if (!iskept(os->mark[pc])) continue;
+    switch (GET_OPCODE(i)) {
+      case OP_JMP:
+        SETARG_sJ(i, newpc[pc + 1 + GETARG_sJ(i)] - (np + 1));
+        break;
+      case OP_FORPREP: case OP_TFORPREP:
+        SETARG_Bx(i, newpc[pc + 1 + GETARG_Bx(i)] - (np + 1));
+        break;
+      case OP_FORLOOP: case OP_TFORLOOP:
+        SETARG_Bx(i, (np + 1) - newpc[pc + 1 - GETARG_Bx(i)]);
+        break;
+      case OP_HOISTCHECK:
+        SETARG_sBx(i, newpc[pc + 1 + GETARG_sBx(i)] - (np + 1));
+        break;
+      default: break;
+    }
+    f->code[np] = i;
+    os->lines[np] = os->lines[pc];
+  }
+  for (pc = 0; pc < fs->ndebugvars; pc++) {
+    LocVar *lv = &f->locvars[pc];
+    lv->startpc = newpc[lv->startpc];
+    lv->endpc = newpc[lv->endpc];
+  }
+  /* rebuild line information */
+  fs->previousline = f->linedefined;
+  fs->iwthabs = 0;
+  fs->nabslineinfo = 0;
+  for (fs->pc = 1; fs->pc <= nk; fs->pc++)
+    savelineinfo(fs, f, os->lines[fs->pc - 1]);
+  fs->pc = nk;
+}
+
+
+/*
+** Optimize the code of a finished function (after 'luaK_finish').
+** The lexer buffer, free between tokens, holds the auxiliary arrays.
+*/
+void luaK_optimize (FuncState *fs) {
+  OptState os;
+  Mbuffer *buff = fs->ls->buff;
+  size_t n = cast_sizet(fs->pc);
+  size_t size = n * (sizeof(RegSet) + 2 * sizeof(int) + 1) + sizeof(int);
+  int pc, i;
+  if (luaZ_sizebuffer(buff) < size)
+    luaZ_resizebuffer(fs->ls->L, buff, size);
+  os.f = fs->f;
+  os.n = fs->pc;
+  os.live = cast(RegSet *, luaZ_buffer(buff));
+  os.lines = cast(int *, os.live + n);
+  os.aux = os.lines + n;
+  os.mark = cast(lu_byte *, os.aux + n + 1);
+  getlines(fs, &os);
+  jumpstoreturns(&os);
+  buildcfg(&os);
+  reuseglobals(&os);
+  /* count active variables at each instruction, for 'liveness' */
+  memset(os.aux, 0, (n + 1) * sizeof(int));
+  for (i = 0; i < fs->ndebugvars; i++) {
+    os.aux[os.f->locvars[i].startpc]++;
+    os.aux[os.f->locvars[i].endpc]--;
+  }
+  for (pc = 1; pc < os.n; pc++)
+    os.aux[pc] += os.aux[pc - 1];
+  memset(os.live, 0, n * sizeof(RegSet));
+  liveness(&os);
+  deadstores(&os);
+  jumpstonext(&os);
+  compact(fs, &os);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Hoisting of loads out of numeric loops (load mode "H"): in the body
+** of an innermost numeric loop, reads of globals, and of constant
+** fields of values read that way, become moves from hidden variables
+** (see 'fornum'). The loop redoes these loads before its first
+** iteration, and then, at the start of each iteration and after each
+** call with fixed results, only if some store into one of their keys
+** (anywhere, through any table) ran since the loads were done. Reads
+** of keys stored with a constant key inside the loop itself are not
+** hoisted. So, a store through a computed key, a multiple-result call,
+** or a metamethod is seen inside the loop only from the next check
+** on, and the '__index' metamethods of the loads run when the loads
+** are redone.
+** =======================================================
+*/
+
+
+/* maximum size of the code to redo hoisted loads, for all checks */
+#define MAXRELOAD	250
+
+
+typedef struct HoistLoad {
+  int src;  /* load with the table (-1 for global '_ENV') */
+  int key;  /* index of the key in the constants */
+} HoistLoad;
+
+
+typedef struct HoistState {
+  FuncState *fs;
+  int reg;  /* register of the guard; hoisted values follow it */
+  int body, end;  /* the body of the loop, with its loop instruction */
+  int env;  /* upvalue '_ENV', or -1 if it cannot be used */
+  lu_byte *stored;  /* constants that are keys of stores in the body */
+  lu_byte *target;  /* instructions in the body that are jump targets */
+  int n;  /* number of hoisted loads */
+  HoistLoad load[MAXHOIST];
+} HoistState;
+
+
+/*
+** Emit a check of the hoisted loads of the innermost loop 'reg', the
+** first of its 'MAXHOIST + 1' hidden variables. The check that starts
+** the body of a loop disables the hoisting of the enclosing loop.
+*/
+int luaK_hoistcheck (FuncState *fs, int reg) {
+  if (fs->hoistcheck != NO_JUMP)
+    fs->f->code[fs->hoistcheck] = CREATE_sJ(OP_JMP, OFFSET_sJ, 0);
+  return codeAsBx(fs, OP_HOISTCHECK, reg, 0);
+}
+
+
+/*
+** A call with fixed results 'e' (the last instruction) in the body of
+** a loop hoisting its loads may change them; check them after it.
+*/
+static void checkaftercall (FuncState *fs, expdesc *e) {
+  if (fs->hoistcheck != NO_JUMP && e->u.info == fs->pc - 1) {
+    Instruction check = fs->f->code[fs->hoistcheck];
+    if (GET_OPCODE(check) == OP_HOISTCHECK)
+      codeAsBx(fs, OP_HOISTCHECK, GETARG_A(check), 0);
+  }
+}
+
+
+/*
+** Destination of the jump in instruction 'i' at 'pc', or -1 if it
+** does not jump.
+*/
+static int jumpdest (Instruction i, int pc) {
+  switch (GET_OPCODE(i)) {
+    case OP_JMP: return pc + 1 + GETARG_sJ(i);
+    case OP_FORPREP: return pc + 2 + GETARG_Bx(i);
+    case OP_TFORPREP: return pc + 1 + GETARG_Bx(i);
+    case OP_FORLOOP: case OP_TFORLOOP: return pc + 1 - GETARG_Bx(i);
+    case OP_HOISTCHECK: return pc + 1 + GETARG_sBx(i);
+    default: return -1;
+  }
+}
+
+
+/*
+** Go through the body matching the reads that can be hoisted with the
+** loads in 'hs': if 'add', add the new ones; otherwise, change the
+** matched reads into moves. A field read right after a hoisted read
+** of its table (and not a jump target) can be hoisted too.
+*/
+static void matchreads (HoistState *hs, int add) {
+  Instruction *code = hs->fs->f->code;
+  int last = -1, lastreg = -1, lastload = -1;  /* last hoisted read */
+  int pc, j;
+  for (pc = hs->body; pc < hs->end; pc++) {
+    Instruction i = code[pc];
+    int src, key;
+    if (GET_OPCODE(i) == OP_GETTABUP && hs->env >= 0 &&
+        GETARG_B(i) == hs->env)
+      src = -1;
+    else if (GET_OPCODE(i) == OP_GETFIELD && pc == last + 1 &&
+             GETARG_B(i) == lastreg && !hs->target[pc - hs->body])
+      src = lastload;
+    else
+      continue;
+    key = GETARG_C(i);
+    if (hs->stored[key])
+      continue;
+    for (j = 0; j < hs->n; j++) {
+      if (hs->load[j].src == src && hs->load[j].key == key)
+        break;
+    }
+    if (j == hs->n) {  /* a new load? */
+      if (!add || hs->n == MAXHOIST)
+        continue;
+      hs->load[j].src = src; hs->load[j].key = key;
+      hs->n++;
+    }
+    if (!add)
+      code[pc] = CREATE_ABCk(OP_MOVE, GETARG_A(i), hs->reg + 1 + j, 0, 0);
+    last = pc; lastreg = GETARG_A(i); lastload = j;
+  }
+}
+
+
+/*
+** Size of the code that redoes the first 'n' loads and jumps back.
+*/
+static int reloadsize (HoistState *hs, int n) {
+  int j, size = 1;
+  for (j = 0; j < n; j++)
+    size += (hs->load[j].src < 0) ? 1 : 4;
+  return size;
+}
+
+
+/*
+** Code the loads of the hoisted values. A field of a value that is
+** false or nil is nil, so that a guarded access in the loop, such as
+** 'if m then m.f() end', does not raise an error here.
+*/
+static void reload (HoistState *hs, int line) {
+  FuncState *fs = hs->fs;
+  int j;
+  for (j = 0; j < hs->n; j++) {
+    int slot = hs->reg + 1 + j;
+    int key = hs->load[j].key;
+    if (hs->load[j].src < 0) {  /* a global? */
+      luaK_codeABC(fs, OP_GETTABUP, slot, hs->env, key);
+      luaK_fixline(fs, line);
+    }
+    else {  /* a field of a hoisted value */
+      int src = hs->reg + 1 + hs->load[j].src;
+      int skip;
+      luaK_codeABC(fs, OP_LOADNIL, slot, 0, 0);
+      luaK_fixline(fs, line);
+      luaK_codeABCk(fs, OP_TEST, src, 0, 0, 0);
+      luaK_fixline(fs, line);
+      skip = luaK_jump(fs);  /* skip the access when value is false */
+      luaK_fixline(fs, line);
+      luaK_codeABC(fs, OP_GETFIELD, slot, src, key);
+      luaK_fixline(fs, line);
+      luaK_patchtohere(fs, skip);
+    }
+  }
+}
+
+
+/*
+** Hoist the loads in the body of the numeric loop with hidden
+** variables at 'reg', whose body starts with the check at 'check' and
+** ends with the loop instruction, the last one coded. Each check of
+** the loop gets its own code to redo the loads, which jumps back to
+** the instruction after the check. If nothing is hoisted, the checks
+** become jumps to the next instruction. The lexer buffer, free
+** between tokens, holds the arrays 'stored' and 'target'.
+*/
+void luaK_hoist (FuncState *fs, int check, int reg, int line) {
+  Proto *f = fs->f;
+  HoistState hs;
+  Mbuffer *buff = fs->ls->buff;
+  size_t size;
+  int nchecks = 0;
+  int pc, j;
+  hs.fs = fs; hs.reg = reg;
+  hs.body = check + 1; hs.end = fs->pc;
+  hs.env = -1;
+  hs.n = 0;
+  size = cast_sizet(fs->nk) + cast_sizet(hs.end - hs.body);
+  if (luaZ_sizebuffer(buff) < size)
+    luaZ_resizebuffer(fs->ls->L, buff, size);
+  hs.stored = cast(lu_byte *, luaZ_buffer(buff));
+  hs.target = hs.stored + fs->nk;
+  memset(hs.stored, 0, size);
+  for (j = 0; j < fs->nups; j++) {
+    if (f->upvalues[j].name == fs->ls->envn)
+      hs.env = j;
+  }
+  for (pc = check; pc < hs.end; pc++) {  /* collect stores, targets... */
+    Instruction i = f->code[pc];
+    int dest = jumpdest(i, pc);
+    switch (GET_OPCODE(i)) {
+      case OP_SETTABUP: case OP_SETFIELD:
+        hs.stored[GETARG_B(i)] = 1;
+        break;
+      case OP_SETUPVAL:
+        if (GETARG_B(i) == hs.env)
+          hs.env = -1;  /* body assigns to '_ENV' */
+        break;
+      case OP_HOISTCHECK:  /* ...and checks */
+        if (GETARG_A(i) == reg) nchecks++;
+        break;
+      default: break;
+    }
+    if (hs.body <= dest && dest < hs.end)
+      hs.target[dest - hs.body] = 1;
+  }
+  if (GET_OPCODE(f->code[check]) == OP_HOISTCHECK) {  /* not disabled? */
+    matchreads(&hs, 1);
+    while (hs.n > 0 && (nchecks * reloadsize(&hs, hs.n) > MAXRELOAD ||
+           hs.end - check + nchecks * reloadsize(&hs, hs.n) >= OFFSET_sBx))
+      hs.n--;  /* too much code; try with fewer loads */
+  }
+  if (hs.n > 0) {
+    int exit;
+    matchreads(&hs, 0);
+    for (j = 0; j < hs.n; j++)  /* stores into these keys must be seen */
+      tsvalue(&f->k[hs.load[j].key])->extra |= WATCHEDKEY;
+    exit = luaK_jump(fs);  /* normal exit from the loop */
+    luaK_fixline(fs, line);
+    for (pc = check; pc < hs.end; pc++) {
+      if (GET_OPCODE(f->code[pc]) == OP_HOISTCHECK &&
+          GETARG_A(f->code[pc]) == reg) {
+        SETARG_sBx(f->code[pc], fs->pc - (pc + 1));
+        reload(&hs, line);
+        luaK_jumpto(fs, pc + 1);
+        luaK_fixline(fs, line);
+      }
+    }
+    luaK_patchtohere(fs, exit);
+  }
+  else {
+    for (pc = check; pc < hs.end; pc++) {
+      if (GET_OPCODE(f->code[pc]) == OP_HOISTCHECK &&
+          GETARG_A(f->code[pc]) == reg)
+        f->code[pc] = CREATE_sJ(OP_JMP, OFFSET_sJ, 0);
+    }
+  }
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Inline expansion of calls (load mode "I"): a call to a local
+** variable holding a small function created in the same function (see
+** 'inlinefunc') becomes a copy of the code of that function, working
+** on registers above the arguments. Its upvalues become the variables
+** or upvalues of the caller that they refer to, its constants go to
+** the constants of the caller, and each of its 'return' instructions
+** becomes a move into the register of the result plus a jump to the
+** end of the copy. The copied instructions keep the lines of the
+** original ones. Unless the variable is <const>, the copy first checks
+** that the variable still has the function it had when it was
+** declared; otherwise it does a regular call, with the arguments
+** already adjusted to the parameters and returning only one result.
+** =======================================================
+*/
+
+
+/*
+** Check whether the calls to function 'p', in register 'reg', can be
+** expanded inline: its code must be short, with no nested functions,
+** no variable arguments, no variables to be closed, and no calls to
+** itself, returning always exactly one value.
+*/
+int luaK_inlinable (FuncState *fs, Proto *p, int reg) {
+  int n = p->sizecode;
+  int i;
+  UNUSED(fs);
+  if ((p->flag & (PF_ISVARARG | PF_LAZYTEXT)) || p->sizep > 0 ||
+      n < 2 || n - 1 > MAXINLINE || p->sizek > MAXINLINE ||
+      GET_OPCODE(p->code[n - 2]) != OP_RETURN1 ||
+      GET_OPCODE(p->code[n - 1]) != OP_RETURN0)
+    return 0;
+  for (i = 0; i < p->sizeupvalues; i++) {
+    if (p->upvalues[i].instack && p->upvalues[i].idx == reg)
+      return 0;  /* function calls itself */
+  }
+  for (i = 0; i < n - 1; i++) {
+    switch (GET_OPCODE(p->code[i])) {
+      case OP_LOADKX: case OP_CLOSE: case OP_TBC: case OP_TAILCALL:
+      case OP_RETURN: case OP_RETURN0: case OP_TFORPREP: case OP_TFORCALL:
+      case OP_TFORLOOP: case OP_CLOSURE: case OP_VARARG:
+      case OP_VARARGPREP: case OP_HOISTCHECK:
+        return 0;
+      default: break;
+    }
+    if (jumpdest(p->code[i], i) == n - 1)
+      return 0;  /* final 'return' (with no values) is reachable */
+  }
+  return 1;
+}
+
+
+/*
+** Check whether a call to inlinable function 'p' with base register
+** 'base' can be expanded inline: the copy of its code must fit in the
+** registers and its constants in the arguments of its instructions.
+** Inside the body of a loop hoisting its loads, the copy of the code
+** cannot have calls, as it would need checks after them.
+*/
+int luaK_caninline (FuncState *fs, Proto *p, int base) {
+  int i;
+  if (base + 1 + p->maxstacksize > MAX_FSTACK ||
+      fs->nk + p->sizek > MAXARG_C + 1)
+    return 0;
+  if (fs->hoistcheck != NO_JUMP) {
+    for (i = 0; i < p->sizecode; i++) {
+      if (GET_OPCODE(p->code[i]) == OP_CALL)
+        return 0;
+    }
+  }
+  return 1;
+}
+
+
+/*
+** Add constant 'v', of the function being expanded, to the constants
+** of the current function.
+*/
+static int inlineK (FuncState *fs, const TValue *v) {
+  switch (ttypetag(v)) {
+    case LUA_VSHRSTR: case LUA_VLNGSTR: return stringK(fs, tsvalue(v));
+    case LUA_VNUMINT: return luaK_intK(fs, ivalue(v));
+    case LUA_VNUMFLT: return luaK_numberK(fs, fltvalue(v));
+    case LUA_VFALSE: return boolF(fs);
+    case LUA_VTRUE: return boolT(fs);
+    default: lua_assert(ttisnil(v)); return nilK(fs);
+  }
+}
+
+
+/*
+** Copy of instruction 'i' of the function being expanded: registers
+** move up to 'r0' and constants go through 'kmap'. Instructions with
+** upvalues and jumps are handled by 'luaK_inline'.
+*/
+static Instruction inlineop (Instruction i, int r0, const int *kmap) {
+  OpCode op = GET_OPCODE(i);
+  switch (op) {
+    case OP_JMP: case OP_EXTRAARG:
+      return i;  /* no registers */
+    case OP_LOADK:
+      SETARG_Bx(i, kmap[GETARG_Bx(i)]);
+      break;
+    case OP_MOVE: case OP_GETI: case OP_ADDI: case OP_SHRI: case OP_SHLI:
+    case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN: case OP_EQ:
+    case OP_LT: case OP_LE: case OP_TESTSET: case OP_MMBIN:
+      SETARG_B(i, r0 + GETARG_B(i));
+      break;
+    case OP_GETTABLE: case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
+    case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR:
+    case OP_BXOR: case OP_SHL: case OP_SHR:
+      SETARG_B(i, r0 + GETARG_B(i));
+      SETARG_C(i, r0 + GETARG_C(i));
+      break;
+    case OP_GETFIELD: case OP_ADDK: case OP_SUBK: case OP_MULK:
+    case OP_MODK: case OP_POWK: case OP_DIVK: case OP_IDIVK:
+    case OP_BANDK: case OP_BORK: case OP_BXORK:
+      SETARG_B(i, r0 + GETARG_B(i));
+      SETARG_C(i, kmap[GETARG_C(i)]);
+      break;
+    case OP_EQK: case OP_MMBINK:
+      SETARG_B(i, kmap[GETARG_B(i)]);
+      break;
+    case OP_SETTABLE: case OP_SETFIELD: case OP_SELF:
+      if (op == OP_SETFIELD)
+        SETARG_B(i, kmap[GETARG_B(i)]);
+      else
+        SETARG_B(i, r0 + GETARG_B(i));
+      /* FALLTHROUGH */
+    case OP_SETI:
+      SETARG_C(i, GETARG_k(i) ? kmap[GETARG_C(i)] : r0 + GETARG_C(i));
+      break;
+    default: break;  /* only register A */
+  }
+  SETARG_A(i, r0 + GETARG_A(i));
+  return i;
+}
+
+
+/*
+** Expand inline a call to function 'p', in register 'freg', with base
+** register 'base'; the arguments are already in the registers after
+** it, adjusted to the parameters of 'p'. The result goes to 'base'.
+** If 'guard' is not 'NO_REG', it has the function that 'freg' should
+** still have for the copy to run.
+*/
+void luaK_inline (FuncState *fs, Proto *p, int base, int freg, int guard,
+                  int line) {
+  int kmap[MAXINLINE];
+  int newpc[MAXINLINE + 1];
+  int n = p->sizecode - 1;  /* (skip final 'return') */
+  int r0 = base + 1;  /* register 0 of the copy */
+  int exits = NO_JUMP;  /* jumps to the end of the copy */
+  int fallback = NO_JUMP;
+  int start, size, i;
+  lua_assert(n <= MAXINLINE && p->sizek <= MAXINLINE);
+  luaK_checkstack(fs, p->maxstacksize - p->numparams);
+  for (i = 0; i < p->sizek; i++)
+    kmap[i] = inlineK(fs, &p->k[i]);
+  if (guard != NO_REG) {
+    luaK_codeABCk(fs, OP_EQ, freg, guard, 0, 0);
+    luaK_fixline(fs, line);
+    fallback = luaK_jump(fs);
+    luaK_fixline(fs, line);
+  }
+  for (i = 0, size = 0; i < n; i++) {  /* compute new positions */
+    newpc[i] = size;
+    size += (GET_OPCODE(p->code[i]) == OP_RETURN1 && i < n - 1) ? 2 : 1;
+  }
+  newpc[n] = size;
+  start = fs->pc;
+  (void)start;  /* avoid "not used" warning when assert is off */
+  for (i = 0; i < n; i++) {
+    Instruction ins = p->code[i];
+    lua_assert(fs->pc == start + newpc[i]);
+    switch (GET_OPCODE(ins)) {
+      case OP_GETUPVAL: case OP_SETUPVAL: {
+        Upvaldesc *up = &p->upvalues[GETARG_B(ins)];
+        int a = r0 + GETARG_A(ins);
+        if (!up->instack)
+          ins = CREATE_ABCk(GET_OPCODE(ins), a, up->idx, 0, 0);
+        else if (GET_OPCODE(ins) == OP_GETUPVAL)
+          ins = CREATE_ABCk(OP_MOVE, a, up->idx, 0, 0);
+        else
+          ins = CREATE_ABCk(OP_MOVE, up->idx, a, 0, 0);
+        break;
+      }
+      case OP_GETTABUP: {
+        Upvaldesc *up = &p->upvalues[GETARG_B(ins)];
+        ins = CREATE_ABCk(up->instack ? OP_GETFIELD : OP_GETTABUP,
+                          r0 + GETARG_A(ins), up->idx,
+                          kmap[GETARG_C(ins)], 0);
+        break;
+      }
+      case OP_SETTABUP: {
+        Upvaldesc *up = &p->upvalues[GETARG_A(ins)];
+        int c = GETARG_C(ins);
+        ins = CREATE_ABCk(up->instack ? OP_SETFIELD : OP_SETTABUP,
+                          up->idx, kmap[GETARG_B(ins)],
+                          GETARG_k(ins) ? kmap[c] : r0 + c, GETARG_k(ins));
+        break;
+      }
+      case OP_JMP: {
+        int dest = i + 1 + GETARG_sJ(ins);
+        SETARG_sJ(ins, newpc[dest] - (newpc[i] + 1));
+        break;
+      }
+      case OP_FORPREP: {  /* jumps to its 'OP_FORLOOP' */
+        int dest = i + 1 + GETARG_Bx(ins);
+        ins = inlineop(ins, r0, kmap);
+        SETARG_Bx(ins, newpc[dest] - (newpc[i] + 1));
+        break;
+      }
+      case OP_FORLOOP: {
+        int dest = i + 1 - GETARG_Bx(ins);
+        ins = inlineop(ins, r0, kmap);
+        SETARG_Bx(ins, newpc[i] + 1 - newpc[dest]);
+        break;
+      }
+      case OP_RETURN1: {
+        luaK_code(fs, CREATE_ABCk(OP_MOVE, base, r0 + GETARG_A(ins), 0, 0));
+        luaK_fixline(fs, luaG_getfuncline(p, i));
+        if (i < n - 1) {  /* not the last one? */
+          luaK_concat(fs, &exits, luaK_jump(fs));
+          luaK_fixline(fs, luaG_getfuncline(p, i));
+        }
+        continue;
+      }
+      default: {
+        ins = inlineop(ins, r0, kmap);
+        break;
+      }
+    }
+    luaK_code(fs, ins);
+    luaK_fixline(fs, luaG_getfuncline(p, i));
+  }
+  if (guard != NO_REG) {  /* function may have changed? */
+    expdesc e;
+    luaK_concat(fs, &exits, luaK_jump(fs));
+    luaK_fixline(fs, line);
+    luaK_patchtohere(fs, fallback);
+    luaK_codeABC(fs, OP_MOVE, base, freg, 0);
+    luaK_fixline(fs, line);
+    e.u.info = luaK_codeABC(fs, OP_CALL, base, p->numparams + 1, 2);
+    luaK_fixline(fs, line);
+    checkaftercall(fs, &e);
+  }
+  luaK_patchtohere(fs, exits);
+}
+
+/* }====================================================== */
@@ -59,6 +59,13 @@ typedef enum UnOpr { OPR_MINUS, OPR_BNOT, OPR_NOT, OPR_LEN, OPR_NOUNOPR } UnOpr;
 
 #define luaK_jumpto(fs,t)	luaK_patchlist(fs, luaK_jump(fs), t)
 
+
+/* maximum number of loads hoisted out of a loop (see 'luaK_hoist') */
+#define MAXHOIST	8
+
+/* maximum size of a function whose calls are expanded inline */
+#define MAXINLINE	32
+
 LUAI_FUNC int luaK_code (FuncState *fs, Instruction i);
 LUAI_FUNC int luaK_codeABx (FuncState *fs, OpCode o, int A, int Bx);
 LUAI_FUNC int luaK_codeABCk (FuncState *fs, OpCode o, int A, int B, int C,
@@ -97,6 +104,13 @@ LUAI_FUNC void luaK_settablesize (FuncState *fs, int pc,
                                   int ra, int asize, int hsize);
 LUAI_FUNC void luaK_setlist (FuncState *fs, int base, int nelems, int tostore);
 LUAI_FUNC void luaK_finish (FuncState *fs);
+LUAI_FUNC void luaK_optimize (FuncState *fs);
+LUAI_FUNC int luaK_hoistcheck (FuncState *fs, int reg);
+LUAI_FUNC void luaK_hoist (FuncState *fs, int check, int reg, int line);
+LUAI_FUNC int luaK_inlinable (FuncState *fs, Proto *p, int reg);
+LUAI_FUNC int luaK_caninline (FuncState *fs, Proto *p, int base);
+LUAI_FUNC void luaK_inline (FuncState *fs, Proto *p, int base, int freg,
+                            int guard, int line);
 LUAI_FUNC l_noret luaK_semerror (LexState *ls, const char *msg);
 
 
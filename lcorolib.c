@@ -45,6 +45,8 @@ static int auxresume (lua_State *L, lua_State *co, int narg) {
       return -1;  /* error flag */
     }
     lua_xmove(co, L, nres);  /* move yielded values */
+    if (status == LUA_OK)  /* coroutine finished? */
+      lua_closethread(co, L);  /* release its resources right away */
     return nres;
   }
   else {
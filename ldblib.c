@@ -423,6 +423,34 @@ static int db_gethook (lua_State *L) {
 }
 
 
+/*
+** setfuel([fuel [, mode]]): no 'fuel' removes the limit
+*/
+static int db_setfuel (lua_State *L) {
+  static const char *const modes[] = {"error", "yield", NULL};
+  static const int modenum[] = {LUA_FUELERROR, LUA_FUELYIELD};
+  if (lua_isnoneornil(L, 1))
+    lua_setfuel(L, -1, LUA_FUELERROR);  /* no limit */
+  else {
+    lua_Integer fuel = luaL_checkinteger(L, 1);
+    int mode = modenum[luaL_checkoption(L, 2, "error", modes)];
+    luaL_argcheck(L, fuel >= 0, 1, "negative fuel");
+    lua_setfuel(L, fuel, mode);
+  }
+  return 0;
+}
+
+
+static int db_getfuel (lua_State *L) {
+  lua_Integer fuel = lua_getfuel(L);
+  if (fuel < 0)  /* no limit? */
+    luaL_pushfail(L);
+  else
+    lua_pushinteger(L, fuel);
+  return 1;
+}
+
+
 static int db_debug (lua_State *L) {
   for (;;) {
     char buffer[250];
@@ -461,6 +489,7 @@ static const luaL_Reg dblib[] = {
 #endif
   {"getuservalue", db_getuservalue},
 #if SLU_DEBUG_LIB_DANGER
+  {"getfuel", db_getfuel},
   {"gethook", db_gethook},
 #endif
   {"getinfo", db_getinfo},
@@ -474,6 +503,7 @@ static const luaL_Reg dblib[] = {
   {"upvalueid", db_upvalueid},
   {"setuservalue", db_setuservalue},
 #if SLU_DEBUG_LIB_DANGER
+  {"setfuel", db_setfuel},
   {"sethook", db_sethook},
 #endif
   {"setlocal", db_setlocal},
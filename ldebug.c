@@ -157,6 +157,55 @@ LUA_API int lua_gethookcount (lua_State *L) {
 }
 
 
+/*
+** Internal values for 'fuelmode', besides 'mode' + 1 from 'lua_setfuel'
+*/
+#define FUELNOLIMIT	0
+#define FUELRESERVED	(LUA_FUELYIELD + 2)  /* reserve already given */
+
+/*
+** Fuel given to error handling after the fuel runs out (just like
+** the extra stack space after a stack overflow)
+*/
+#if !defined(LUAI_FUELRESERVE)
+#define LUAI_FUELRESERVE	1000
+#endif
+
+
+/*
+** Set the fuel of the state: how many back edges (loop iterations) and
+** calls to Lua functions all its code can still execute. A negative
+** 'fuel' means no limit. When the fuel runs out, the interpreter raises an error or,
+** with LUA_FUELYIELD and a yieldable thread, yields (see 'luaG_nofuel').
+** Unlike a count hook, the fuel costs the interpreter only a decrement
+** at those points.
+*/
+LUA_API void lua_setfuel (lua_State *L, lua_Integer fuel, int mode) {
+  global_State *g = G(L);
+  lua_lock(L);
+  if (fuel < 0) {  /* no limit? */
+    g->fuel = MAX_LMEM;
+    g->fuelmode = FUELNOLIMIT;
+  }
+  else {
+    g->fuel = (fuel >= MAX_LMEM) ? MAX_LMEM : cast(l_mem, fuel);
+    g->fuelmode = cast_byte(mode + 1);
+  }
+  lua_unlock(L);
+}
+
+
+LUA_API lua_Integer lua_getfuel (lua_State *L) {
+  global_State *g = G(L);
+  if (g->fuelmode == FUELNOLIMIT)
+    return -1;
+  else if (g->fuelmode == FUELRESERVED || g->fuel < 0)
+    return 0;  /* fuel is over */
+  else
+    return g->fuel;
+}
+
+
 LUA_API int lua_getstack (lua_State *L, int level, lua_Debug *ar) {
   int status;
   CallInfo *ci;
@@ -217,14 +266,33 @@ const char *luaG_findlocal (lua_State *L, CallInfo *ci, int n, StkId *pos) {
 }
 
 
+/*
+** Compile Lua function 'cl' if it was not compiled yet (see
+** 'luaD_compilelazy'), to get its debug information. In case of
+** errors, it stays uncompiled.
+*/
+static void compilelazy (lua_State *L, LClosure *cl) {
+  if (cl->p->flag & PF_LAZYTEXT) {
+    setclLvalue2s(L, L->top.p, cl);  /* anchor it */
+    luaD_inctop(L);
+    if (luaD_compilelazy(L, cl->p) != LUA_OK)
+      L->top.p--;  /* remove error message */
+    L->top.p--;  /* remove closure */
+  }
+}
+
+
 LUA_API const char *lua_getlocal (lua_State *L, const lua_Debug *ar, int n) {
   const char *name;
   lua_lock(L);
   if (ar == NULL) {  /* information about non-active function? */
     if (!isLfunction(s2v(L->top.p - 1)))  /* not a Lua function? */
       name = NULL;
-    else  /* consider live variables at function start (parameters) */
-      name = luaF_getlocalname(clLvalue(s2v(L->top.p - 1))->p, n, 0);
+    else {  /* consider live variables at function start (parameters) */
+      LClosure *cl = clLvalue(s2v(L->top.p - 1));
+      compilelazy(L, cl);
+      name = luaF_getlocalname(cl->p, n, 0);
+    }
   }
   else {  /* active function; get information through 'ar' */
     StkId pos = NULL;  /* to avoid warnings */
@@ -295,10 +363,13 @@ static void collectvalidlines (lua_State *L, Closure *f) {
   else {
     const Proto *p = f->l.p;
     int currentline = p->linedefined;
-    Table *t = luaH_new(L);  /* new table to store active lines */
+    Table *t;
+    compilelazy(L, &f->l);
+    t = luaH_new(L);  /* new table to store active lines */
     sethvalue2s(L, L->top.p, t);  /* push it on stack */
     api_incr_top(L);
-    if (p->lineinfo != NULL) {  /* proto with debug information? */
+    if (p->lineinfo != NULL &&  /* proto with debug information? */
+        !(p->flag & PF_LAZYTEXT)) {  /* (and already compiled) */
       int i;
       TValue v;
       setbtvalue(&v);  /* boolean 'true' to be the value of all indices */
@@ -492,14 +563,34 @@ static const char *kname (const Proto *p, int index, const char **name) {
 }
 
 
+/*
+** Registers of "(for hoist)" variables hold loads hoisted out of a
+** loop, which are redone after the loop body (see 'luaK_hoist'). Find
+** the instruction that loads register 'reg' there.
+*/
+static int hoistedload (const Proto *p, int pc, int reg) {
+  for (; pc < p->sizecode; pc++) {
+    Instruction i = p->code[pc];
+    OpCode op = GET_OPCODE(i);
+    if ((op == OP_GETTABUP || op == OP_GETFIELD || op == OP_MOVE) &&
+        GETARG_A(i) == reg)
+      return pc;
+  }
+  return -1;
+}
+
+
 static const char *basicgetobjname (const Proto *p, int *ppc, int reg,
                                     const char **name) {
   int pc = *ppc;
   *name = luaF_getlocalname(p, reg + 1, pc);
-  if (*name)  /* is a local? */
+  if (*name == NULL)  /* not a local? */
+    pc = findsetreg(p, pc, reg);  /* try symbolic execution */
+  else if (strcmp(*name, "(for hoist)") == 0)
+    pc = hoistedload(p, pc, reg);  /* name it as the original load */
+  else
     return "local";
-  /* else try symbolic execution */
-  *ppc = pc = findsetreg(p, pc, reg);
+  *ppc = pc;
   if (pc != -1) {  /* could find instruction? */
     Instruction i = p->code[pc];
     OpCode op = GET_OPCODE(i);
@@ -908,6 +999,40 @@ int luaG_tracecall (lua_State *L) {
 }
 
 
+/*
+** Called by the interpreter when the fuel runs out, at a back edge or
+** a call; the instruction to be repeated after a yield is right before
+** 'pc'. Without a fuel limit, the counter is just refilled. The first
+** error gives a small reserve so that handlers can run; after that,
+** the fuel stays exhausted (so that a 'pcall' cannot escape it) until
+** 'lua_setfuel' is called again.
+*/
+void luaG_nofuel (lua_State *L, const Instruction *pc) {
+  global_State *g = G(L);
+  CallInfo *ci = L->ci;
+  if (g->fuelmode == FUELNOLIMIT) {
+    g->fuel = MAX_LMEM;
+    return;
+  }
+  g->fuel = 0;  /* next back edge or call will stop again */
+  ci->u.l.savedpc = pc;  /* save 'pc' */
+  if (!luaP_isIT(*(pc - 1)))  /* top not being used? */
+    L->top.p = ci->top.p;  /* correct top */
+  if (g->fuelmode == LUA_FUELYIELD + 1 && yieldable(L)) {
+    L->status = LUA_YIELD;
+    ci->u2.nyield = 0;  /* no results */
+    if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))
+      ci->callstatus |= CIST_HOOKYIELD;  /* hooks already ran for 'pc - 1' */
+    luaD_throw(L, LUA_YIELD);  /* resume will repeat the instruction */
+  }
+  if (g->fuelmode != FUELRESERVED) {  /* first error? */
+    g->fuelmode = FUELRESERVED;
+    g->fuel = LUAI_FUELRESERVE;
+  }
+  luaG_runerror(L, "out of fuel");
+}
+
+
 /*
 ** Traces the execution of a Lua function. Called before the execution
 ** of each opcode, when debug is on. 'L->oldpc' stores the last
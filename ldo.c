@@ -74,6 +74,7 @@
 #define LUAI_TRY(L,c,a) \
 	try { a } catch(...) { if ((c)->status == 0) (c)->status = -1; }
 #define luai_jmpbuf		int  /* dummy variable */
+#define luai_freetry		1  /* entering a 'try' costs nothing */
 
 #elif defined(LUA_USE_POSIX)				/* }{ */
 
@@ -94,12 +95,24 @@
 #endif							/* } */
 
 
+/*
+** luai_freetry signals that setting a protection has no cost. In that
+** case, 'lua_pcallk' outside coroutines always sets its own protection
+** (see 'luaD_canrecover'), as the recovery done by 'luaD_pcallrec' has
+** to unwind more frames (and unwinding is what costs there).
+*/
+#if !defined(luai_freetry)
+#define luai_freetry		0
+#endif
+
+
 
 /* chain list of long jump buffers */
 struct lua_longjmp {
   struct lua_longjmp *previous;
   luai_jmpbuf b;
   volatile int status;  /* error code */
+  l_uint32 nny;  /* non-yieldable level of recoverable pcalls (0: none) */
 };
 
 
@@ -154,6 +167,7 @@ int luaD_rawrunprotected (lua_State *L, Pfunc f, void *ud) {
   l_uint32 oldnCcalls = L->nCcalls;
   struct lua_longjmp lj;
   lj.status = LUA_OK;
+  lj.nny = 0;  /* cannot recover pcalls */
   lj.previous = L->errorJmp;  /* chain new error handler */
   L->errorJmp = &lj;
   LUAI_TRY(L, &lj,
@@ -270,6 +284,117 @@ static void correctstack (lua_State *L, StkId oldstack) {
 #endif
 
 
+/*
+** {==================================================================
+** Stacks in reserved address space
+** ===================================================================
+*/
+#if defined(LUA_USE_MAPSTACK) && defined(LUA_USE_POSIX)	/* { */
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+#if !defined(MAP_NORESERVE)
+#define MAP_NORESERVE	0
+#endif
+
+
+/* bytes used by a stack with 'n' slots */
+#define stackbytes(n)	(cast_sizet((n) + EXTRA_STACK) * sizeof(StackValue))
+
+/* size of the address space reserved for a stack */
+#define MAPSTACKSIZE	stackbytes(ERRORSTACKSIZE)
+
+/* a stack goes to its own reserved space when it becomes a large object */
+#define needsmap(L,n)	((L)->stackmapped || luaM_islarge(stackbytes(n)))
+
+
+/*
+** Give back to the system the whole pages of a mapped stack after its
+** slot 'n'. (Their slots read as zeros, that is, nil, if used again.)
+*/
+static void releasepages (StkId stack, int n, int oldn) {
+  size_t pg = cast_sizet(sysconf(_SC_PAGESIZE));
+  size_t start = stackbytes(n);
+  size_t end = stackbytes(oldn);
+  start = (start + pg - 1) / pg * pg;  /* round up to a page */
+  if (start < end)
+    madvise(cast_charp(stack) + start, end - start, MADV_DONTNEED);
+}
+
+
+/*
+** Resize the stack inside a reserved area, first moving it to a new
+** area if needed. A stack moves only once: the area can hold the
+** largest possible stack (plus the space for errors), and the system
+** provides its pages only when they are touched. So, growing or
+** shrinking it again does not need to correct any pointer into it.
+*/
+static int reallocmapped (lua_State *L, int newsize, int raiseerror) {
+  int oldsize = stacksize(L);
+  if (!L->stackmapped) {  /* must move the stack to a reserved area? */
+    StkId oldstack = L->stack.p;
+    void *area = mmap(NULL, MAPSTACKSIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (l_unlikely(area == MAP_FAILED))
+      goto fail;
+    relstack(L);  /* change pointers to offsets */
+    memcpy(area, oldstack, stackbytes(oldsize));
+    L->stack.p = cast(StkId, area);
+    correctstack(L, oldstack);  /* change offsets back to pointers */
+    luaM_freearray(L, oldstack, cast_sizet(oldsize + EXTRA_STACK));
+    G(L)->GCdebt -= cast(l_mem, stackbytes(oldsize));  /* moved, not freed */
+    L->stackmapped = 1;
+  }
+  if (l_unlikely(!luaM_account(L, stackbytes(oldsize), stackbytes(newsize))))
+    goto fail;
+  if (newsize < oldsize)
+    releasepages(L->stack.p, newsize, oldsize);
+  else {
+    int i;
+    for (i = oldsize + EXTRA_STACK; i < newsize + EXTRA_STACK; i++)
+      setnilvalue(s2v(L->stack.p + i)); /* erase new segment */
+  }
+  L->stack_last.p = L->stack.p + newsize;
+  return 1;
+ fail:
+  if (raiseerror)
+    luaM_error(L);
+  return 0;  /* do not raise an error */
+}
+
+
+/*
+** Free the stack of a thread
+*/
+void luaD_freestack (lua_State *L) {
+  if (L->stackmapped) {
+    munmap(L->stack.p, MAPSTACKSIZE);
+    luaM_account(L, stackbytes(stacksize(L)), 0);
+  }
+  else
+    luaM_freearray(L, L->stack.p, cast_sizet(stacksize(L) + EXTRA_STACK));
+}
+
+#else						/* }{ */
+
+#define needsmap(L,n)	0
+#define reallocmapped(L,n,r)	0
+
+
+void luaD_freestack (lua_State *L) {
+  luaM_freearray(L, L->stack.p, cast_sizet(stacksize(L) + EXTRA_STACK));
+}
+
+#endif						/* } */
+
+/* }================================================================== */
+
+
 /*
 ** Reallocate the stack to a new size, correcting all pointers into it.
 ** In case of allocation error, raise an error or return false according
@@ -282,6 +407,9 @@ int luaD_reallocstack (lua_State *L, int newsize, int raiseerror) {
   StkId oldstack = L->stack.p;
   lu_byte oldgcstop = G(L)->gcstopem;
   lua_assert(newsize <= MAXSTACK || newsize == ERRORSTACKSIZE);
+  luaF_freeupvalidx(L);  /* index of upvalues has the size of the stack */
+  if (needsmap(L, newsize))
+    return reallocmapped(L, newsize, raiseerror);
   relstack(L);  /* change pointers to offsets */
   G(L)->gcstopem = 1;  /* stop emergency collection */
   newstack = luaM_reallocvector(L, oldstack, oldsize + EXTRA_STACK,
@@ -455,7 +583,7 @@ static void rethook (lua_State *L, CallInfo *ci, int nres) {
     if (isLua(ci)) {
       Proto *p = ci_func(ci)->p;
       if (p->flag & PF_ISVARARG)
-        delta = ci->u.l.nextraargs + p->numparams + 1;
+        delta = luaT_vadelta(ci, p->numparams + 1);
     }
     ci->func.p += delta;  /* if vararg, back to virtual 'func' */
     ftransfer = cast_int(firstres - ci->func.p);
@@ -487,6 +615,23 @@ static StkId tryfuncTM (lua_State *L, StkId func) {
 }
 
 
+/*
+** Compile the Lua function 'func', with prototype 'p', before calling
+** it; compilation errors are runtime errors. Return 'func', which may
+** have moved.
+*/
+static StkId compilelazy (lua_State *L, Proto *p, StkId func) {
+  ptrdiff_t funcr = savestack(L, func);
+  int status = luaD_compilelazy(L, p);
+  if (l_unlikely(status != LUA_OK)) {
+    if (status == LUA_ERRMEM)
+      luaD_throw(L, status);
+    luaG_errormsg(L);  /* message is on the top */
+  }
+  return restorestack(L, funcr);
+}
+
+
 /* Generic case for 'moveresult */
 l_sinline void genmoveresults (lua_State *L, StkId res, int nres,
                                              int wanted) {
@@ -616,6 +761,36 @@ l_sinline int precallC (lua_State *L, StkId func, int nresults,
 }
 
 
+/*
+** Call a leaf C function (see 'lua_pushleaf') from the interpreter,
+** with 'nresults' being 0 or 1 and no hooks. The API still needs a
+** CallInfo for the function, but as a leaf neither calls Lua nor
+** yields, the call can skip the hooks, the translation of C++
+** exceptions, and the generic adjustment of results.
+*/
+void luaD_callleaf (lua_State *L, StkId func, int nresults) {
+  int n;  /* number of returns */
+  CallInfo *ci;
+  checkstackp(L, LUA_MINSTACK, func);  /* ensure minimum stack size */
+  L->ci = ci = prepCallInfo(L, func, nresults, CIST_C,
+                               L->top.p + LUA_MINSTACK);
+  lua_unlock(L);
+  n = (*clCvalue(s2v(func))->f)(L);  /* do the actual call */
+  lua_lock(L);
+  api_checknelems(L, n);
+  if (nresults == 0)
+    L->top.p = func;
+  else {
+    if (n == 0)  /* no results? */
+      setnilvalue(s2v(func));  /* adjust with nil */
+    else
+      setobjs2s(L, func, L->top.p - n);  /* move result to proper place */
+    L->top.p = func + 1;
+  }
+  L->ci = ci->previous;  /* back to caller */
+}
+
+
 /*
 ** Prepare a function for a tail call, building its call info on top
 ** of the current call info. 'narg1' is the number of arguments plus 1
@@ -632,9 +807,13 @@ int luaD_pretailcall (lua_State *L, CallInfo *ci, StkId func,
       return precallC(L, func, LUA_MULTRET, fvalue(s2v(func)));
     case LUA_VLCL: {  /* Lua function */
       Proto *p = clLvalue(s2v(func))->p;
-      int fsize = p->maxstacksize;  /* frame size */
-      int nfixparams = p->numparams;
+      int fsize;  /* frame size */
+      int nfixparams;
       int i;
+      if (l_unlikely(p->flag & PF_LAZYTEXT))  /* not compiled yet? */
+        func = compilelazy(L, p, func);
+      fsize = p->maxstacksize;
+      nfixparams = p->numparams;
       checkstackp(L, fsize - delta, func);
       ci->func.p -= delta;  /* restore 'func' (if vararg) */
       for (i = 0; i < narg1; i++)  /* move down function and arguments */
@@ -680,8 +859,12 @@ CallInfo *luaD_precall (lua_State *L, StkId func, int nresults) {
       CallInfo *ci;
       Proto *p = clLvalue(s2v(func))->p;
       int narg = cast_int(L->top.p - func) - 1;  /* number of real arguments */
-      int nfixparams = p->numparams;
-      int fsize = p->maxstacksize;  /* frame size */
+      int nfixparams;
+      int fsize;  /* frame size */
+      if (l_unlikely(p->flag & PF_LAZYTEXT))  /* not compiled yet? */
+        func = compilelazy(L, p, func);
+      nfixparams = p->numparams;
+      fsize = p->maxstacksize;
       checkstackp(L, fsize, func);
       L->ci = ci = prepCallInfo(L, func, nresults, 0, func + 1 + fsize);
       ci->u.l.savedpc = p->code;  /* starting point */
@@ -796,7 +979,7 @@ static void finishCcall (lua_State *L, CallInfo *ci) {
   else {
     int status = LUA_YIELD;  /* default if there were no errors */
     /* must have a continuation and must be able to call it */
-    lua_assert(ci->u.c.k != NULL && yieldable(L));
+    lua_assert(ci->u.c.k != NULL);
     if (ci->callstatus & CIST_YPCALL)   /* was inside a 'lua_pcallk'? */
       status = finishpcallk(L, ci);  /* finish it */
     adjustresults(L, LUA_MULTRET);  /* finish 'lua_callk' */
@@ -810,14 +993,12 @@ static void finishCcall (lua_State *L, CallInfo *ci) {
 
 
 /*
-** Executes "full continuation" (everything in the stack) of a
-** previously interrupted coroutine until the stack is empty (or another
-** interruption long-jumps out of the loop).
+** Executes the continuation of an interrupted stack down to level
+** 'base' (or until another interruption long-jumps out of the loop).
 */
-static void unroll (lua_State *L, void *ud) {
+static void unrollto (lua_State *L, CallInfo *base) {
   CallInfo *ci;
-  UNUSED(ud);
-  while ((ci = L->ci) != &L->base_ci) {  /* something in the stack */
+  while ((ci = L->ci) != base) {  /* something in the stack */
     if (!isLua(ci))  /* C function? */
       finishCcall(L, ci);  /* complete its execution */
     else {  /* Lua function */
@@ -828,13 +1009,24 @@ static void unroll (lua_State *L, void *ud) {
 }
 
 
+/*
+** Executes "full continuation" (everything in the stack) of a
+** previously interrupted coroutine until the stack is empty (or another
+** interruption long-jumps out of the loop).
+*/
+static void unroll (lua_State *L, void *ud) {
+  UNUSED(ud);
+  unrollto(L, &L->base_ci);
+}
+
+
 /*
 ** Try to find a suspended protected call (a "recover point") for the
-** given thread.
+** given thread above level 'base'.
 */
-static CallInfo *findpcall (lua_State *L) {
+static CallInfo *findpcall (lua_State *L, CallInfo *base) {
   CallInfo *ci;
-  for (ci = L->ci; ci != NULL; ci = ci->previous) {  /* search for a pcall */
+  for (ci = L->ci; ci != base; ci = ci->previous) {  /* search for a pcall */
     if (ci->callstatus & CIST_YPCALL)
       return ci;
   }
@@ -873,10 +1065,9 @@ static void resume (lua_State *L, void *ud) {
   else {  /* resuming from previous yield */
     lua_assert(L->status == LUA_YIELD);
     L->status = LUA_OK;  /* mark that it is running (again) */
-    if (isLua(ci)) {  /* yielded inside a hook? */
-      /* undo increment made by 'luaG_traceexec': instruction was not
-         executed yet */
-      lua_assert(ci->callstatus & CIST_HOOKYIELD);
+    if (isLua(ci)) {  /* yielded inside a hook or out of fuel? */
+      /* undo increment made by 'luaG_traceexec' or 'luaG_nofuel':
+         instruction was not executed yet */
       ci->u.l.savedpc--;
       L->top.p = firstArg;  /* discard arguments */
       luaV_execute(L, ci);  /* just continue running Lua code */
@@ -905,7 +1096,7 @@ static void resume (lua_State *L, void *ud) {
 */
 static int precover (lua_State *L, int status) {
   CallInfo *ci;
-  while (errorstatus(status) && (ci = findpcall(L)) != NULL) {
+  while (errorstatus(status) && (ci = findpcall(L, NULL)) != NULL) {
     L->ci = ci;  /* go down to recovery functions */
     setcistrecst(ci, status);  /* status to finish 'pcall' */
     status = luaD_rawrunprotected(L, unroll, NULL);
@@ -1024,6 +1215,22 @@ int luaD_closeprotected (lua_State *L, ptrdiff_t level, int status) {
 }
 
 
+/*
+** Restore the state of a protected call that ended with an error,
+** closing its pending to-be-closed variables and leaving the error
+** object at 'old_top'.
+*/
+static int pcallerror (lua_State *L, int status, CallInfo *old_ci,
+                       lu_byte old_allowhooks, ptrdiff_t old_top) {
+  L->ci = old_ci;
+  L->allowhook = old_allowhooks;
+  status = luaD_closeprotected(L, old_top, status);
+  luaD_seterrorobj(L, status, restorestack(L, old_top));
+  luaD_shrinkstack(L);   /* restore stack size in case of overflow */
+  return status;
+}
+
+
 /*
 ** Call the C function 'func' in protected mode, restoring basic
 ** thread information ('allowhook', etc.) and in particular
@@ -1037,18 +1244,74 @@ int luaD_pcall (lua_State *L, Pfunc func, void *u,
   ptrdiff_t old_errfunc = L->errfunc;
   L->errfunc = ef;
   status = luaD_rawrunprotected(L, func, u);
-  if (l_unlikely(status != LUA_OK)) {  /* an error occurred? */
-    L->ci = old_ci;
-    L->allowhook = old_allowhooks;
-    status = luaD_closeprotected(L, old_top, status);
-    luaD_seterrorobj(L, status, restorestack(L, old_top));
-    luaD_shrinkstack(L);   /* restore stack size in case of overflow */
+  if (l_unlikely(status != LUA_OK))  /* an error occurred? */
+    status = pcallerror(L, status, old_ci, old_allowhooks, old_top);
+  L->errfunc = old_errfunc;
+  return status;
+}
+
+
+/*
+** Call function 'func' in protected mode, like 'luaD_pcall'. Moreover,
+** this protection also serves the calls to 'lua_pcallk' made inside
+** it without intervening non-yieldable calls: those calls set no
+** protection of their own (see 'luaD_canrecover'); they only mark
+** their 'CallInfo' with CIST_YPCALL. An error inside one of them
+** lands here, which goes back to that recover point and unrolls the
+** stack down to this call, as 'lua_resume' does for coroutines.
+*/
+int luaD_pcallrec (lua_State *L, StkId func, int nresults, ptrdiff_t ef) {
+  CallInfo *old_ci = L->ci;
+  lu_byte old_allowhooks = L->allowhook;
+  ptrdiff_t old_errfunc = L->errfunc;
+  ptrdiff_t old_top = savestack(L, func);
+  l_uint32 oldnCcalls = L->nCcalls;
+  CallInfo *ci;
+  int status;
+  struct lua_longjmp lj;
+  L->errfunc = ef;
+  lj.status = LUA_OK;
+  lj.nny = (oldnCcalls + nyci) & 0xffff0000;  /* level inside the call */
+  lj.previous = L->errorJmp;  /* chain new error handler */
+  L->errorJmp = &lj;
+  LUAI_TRY(L, &lj,
+    luaD_callnoyield(L, func, nresults);
+  );
+  while (errorstatus(lj.status) && (ci = findpcall(L, old_ci)) != NULL) {
+    L->ci = ci;  /* go down to recovery function */
+    setcistrecst(ci, lj.status);  /* status to finish 'pcall' */
+    lj.status = LUA_OK;
+    L->nCcalls = oldnCcalls + nyci;  /* as inside 'luaD_callnoyield' */
+    LUAI_TRY(L, &lj,
+      unrollto(L, old_ci);
+    );
   }
+  L->errorJmp = lj.previous;  /* restore old error handler */
+  L->nCcalls = oldnCcalls;
+  status = lj.status;
+  if (l_unlikely(status != LUA_OK))  /* an unrecoverable error? */
+    status = pcallerror(L, status, old_ci, old_allowhooks, old_top);
   L->errfunc = old_errfunc;
   return status;
 }
 
 
+/*
+** True if an error at the current point can be recovered by a
+** 'luaD_pcallrec', that is, if the innermost protection is one and
+** there are no non-yieldable calls between it and this point.
+*/
+int luaD_canrecover (lua_State *L) {
+#if luai_freetry
+  UNUSED(L);
+  return 0;
+#else
+  struct lua_longjmp *lj = L->errorJmp;
+  return (lj != NULL && lj->nny == (L->nCcalls & 0xffff0000));
+#endif
+}
+
+
 
 /*
 ** Execute a protected parser.
@@ -1059,6 +1322,7 @@ struct SParser {  /* data to 'f_parser' */
   Dyndata dyd;  /* dynamic structures used by the parser */
   const char *mode;
   const char *name;
+  Proto *lazy;  /* prototype to be compiled by 'f_lazy' */
 };
 
 
@@ -1086,30 +1350,62 @@ static void f_parser (lua_State *L, void *ud) {
   }
   else {
     checkmode(L, mode, "text");
-    cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c);
+    cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c,
+                     strchr(mode, 'L') != NULL, strchr(mode, 'O') != NULL,
+                     strchr(mode, 'H') != NULL, strchr(mode, 'I') != NULL);
   }
   lua_assert(cl->nupvalues == cl->p->sizeupvalues);
   luaF_initupvals(L, cl);
 }
 
 
-int luaD_protectedparser (lua_State *L, ZIO *z, const char *name,
-                                        const char *mode) {
-  struct SParser p;
+static void f_lazy (lua_State *L, void *ud) {
+  struct SParser *p = cast(struct SParser *, ud);
+  luaY_parselazy(L, p->lazy, p->z, &p->buff, &p->dyd);
+}
+
+
+/*
+** Call parsing function 'f' in protected mode, freeing the parser
+** structures afterwards.
+*/
+static int runparser (lua_State *L, struct SParser *p, Pfunc f) {
   int status;
   incnny(L);  /* cannot yield during parsing */
-  p.z = z; p.name = name; p.mode = mode;
-  p.dyd.actvar.arr = NULL; p.dyd.actvar.size = 0;
-  p.dyd.gt.arr = NULL; p.dyd.gt.size = 0;
-  p.dyd.label.arr = NULL; p.dyd.label.size = 0;
-  luaZ_initbuffer(L, &p.buff);
-  status = luaD_pcall(L, f_parser, &p, savestack(L, L->top.p), L->errfunc);
-  luaZ_freebuffer(L, &p.buff);
-  luaM_freearray(L, p.dyd.actvar.arr, cast_sizet(p.dyd.actvar.size));
-  luaM_freearray(L, p.dyd.gt.arr, cast_sizet(p.dyd.gt.size));
-  luaM_freearray(L, p.dyd.label.arr, cast_sizet(p.dyd.label.size));
+  p->dyd.actvar.arr = NULL; p->dyd.actvar.size = 0;
+  p->dyd.gt.arr = NULL; p->dyd.gt.size = 0;
+  p->dyd.label.arr = NULL; p->dyd.label.size = 0;
+  p->dyd.skim.arr = NULL; p->dyd.skim.size = 0;
+  luaZ_initbuffer(L, &p->buff);
+  status = luaD_pcall(L, f, p, savestack(L, L->top.p), L->errfunc);
+  luaZ_freebuffer(L, &p->buff);
+  luaM_freearray(L, p->dyd.actvar.arr, cast_sizet(p->dyd.actvar.size));
+  luaM_freearray(L, p->dyd.gt.arr, cast_sizet(p->dyd.gt.size));
+  luaM_freearray(L, p->dyd.label.arr, cast_sizet(p->dyd.label.size));
+  luaM_freearray(L, p->dyd.skim.arr, cast_sizet(p->dyd.skim.size));
   decnny(L);
   return status;
 }
 
 
+int luaD_protectedparser (lua_State *L, ZIO *z, const char *name,
+                                        const char *mode) {
+  struct SParser p;
+  p.z = z; p.name = name; p.mode = mode; p.lazy = NULL;
+  return runparser(L, &p, f_parser);
+}
+
+
+/*
+** Compile prototype 'p', flagged PF_LAZYTEXT, in place. In case of
+** errors, leaves the error message on the top.
+*/
+int luaD_compilelazy (lua_State *L, Proto *p) {
+  struct SParser sp;
+  ZIO z;
+  luaZ_initmem(L, &z, cast_charp(p->lineinfo), cast_sizet(p->sizelineinfo));
+  sp.z = &z; sp.name = NULL; sp.mode = NULL; sp.lazy = p;
+  return runparser(L, &sp, f_lazy);
+}
+
+
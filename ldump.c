@@ -16,6 +16,7 @@
 #include "lua.h"
 
 #include "lapi.h"
+#include "ldo.h"
 #include "lgc.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -29,9 +30,12 @@ typedef struct {
   void *data;
   size_t offset;  /* current position relative to beginning of dump */
   int strip;
+  int lazy;  /* dump nested functions as blocks to be loaded on demand */
   int status;
   Table *h;  /* table to track saved strings */
   lua_Integer nstr;  /* counter for counting saved strings */
+  Table *sizes;  /* sizes of blocks already computed (lazy format) */
+  int depth;  /* nesting level of blocks (lazy format) */
 } DumpState;
 
 
@@ -191,12 +195,81 @@ static void dumpConstants (DumpState *D, const Proto *f) {
 }
 
 
+/*
+** Start a new list of saved strings for a block of the lazy format,
+** with 'source' as its first string. The table is anchored in
+** 'sizes', under the depth of the block. (It cannot go to the stack,
+** where the writer may be keeping things.)
+*/
+static void newstrings (DumpState *D, TString *source) {
+  lua_State *L = D->L;
+  TValue v;
+  D->h = luaH_new(L);
+  sethvalue(L, &v, D->h);
+  luaH_setint(L, D->sizes, D->depth, &v);  /* anchor it */
+  luaC_barrierback(L, obj2gco(D->sizes), &v);
+  D->nstr = 0;
+  if (source != NULL) {
+    TValue key, value;
+    setsvalue(L, &key, source);
+    setivalue(&value, ++D->nstr);
+    luaH_set(L, D->h, &key, &value);
+  }
+}
+
+
+static int countwriter (lua_State *L, const void *b, size_t size, void *ud) {
+  UNUSED(L); UNUSED(b); UNUSED(size); UNUSED(ud);
+  return 0;
+}
+
+
+/*
+** Dump function 'f' as a block of the lazy format: its size, padding
+** for alignment, and its contents. To know the size, the block is
+** first dumped to nowhere; sizes are memoized, so that each level of
+** nesting costs one extra pass over its contents. 'psource' is the
+** source saved for the enclosing function.
+*/
+static void dumpLazy (DumpState *D, const Proto *f, TString *psource) {
+  lua_State *L = D->L;
+  DumpState B = *D;  /* state for the block */
+  TValue key, size;
+  B.depth++;
+  setpvalue(&key, cast_voidp(f));
+  if (tagisempty(luaH_get(D->sizes, &key, &size))) {  /* unknown size? */
+    B.writer = countwriter;
+    B.offset = 0;
+    newstrings(&B, psource);
+    dumpFunction(&B, f);
+    setivalue(&size, cast(lua_Integer, B.offset));
+    luaH_set(L, D->sizes, &key, &size);
+  }
+  dumpSize(D, cast_sizet(ivalue(&size)));
+  dumpAlign(D, LUAC_LAZYALIGN);
+  B.writer = D->writer;
+  B.status = D->status;
+  B.offset = 0;  /* alignment inside the block is relative to its start */
+  newstrings(&B, psource);
+  dumpFunction(&B, f);
+  lua_assert(B.offset == cast_sizet(ivalue(&size)) || B.status != 0);
+  D->offset += B.offset;
+  D->status = B.status;
+}
+
+
 static void dumpProtos (DumpState *D, const Proto *f) {
   int i;
   int n = f->sizep;
   dumpInt(D, n);
-  for (i = 0; i < n; i++)
-    dumpFunction(D, f->p[i]);
+  for (i = 0; i < n; i++) {
+    if (f->p[i]->flag & PF_LAZY)  /* not loaded yet? */
+      luaU_loadlazy(D->L, cast(Proto *, f), i);  /* load it to dump it */
+    if (D->lazy)
+      dumpLazy(D, f->p[i], D->strip ? NULL : f->source);
+    else
+      dumpFunction(D, f->p[i]);
+  }
 }
 
 
@@ -239,6 +312,11 @@ static void dumpDebug (DumpState *D, const Proto *f) {
 
 
 static void dumpFunction (DumpState *D, const Proto *f) {
+  if (f->flag & PF_LAZYTEXT) {  /* not compiled yet? */
+    int status = luaD_compilelazy(D->L, cast(Proto *, f));
+    if (status != LUA_OK)
+      luaD_throw(D->L, status);
+  }
   dumpInt(D, f->linedefined);
   dumpInt(D, f->lastlinedefined);
   dumpByte(D, f->numparams);
@@ -256,7 +334,7 @@ static void dumpFunction (DumpState *D, const Proto *f) {
 static void dumpHeader (DumpState *D) {
   dumpLiteral(D, LUA_SIGNATURE);
   dumpByte(D, LUAC_VERSION);
-  dumpByte(D, LUAC_FORMAT);
+  dumpByte(D, D->lazy ? LUAC_FORMATLAZY : LUAC_FORMAT);
   dumpLiteral(D, LUAC_DATA);
   dumpByte(D, sizeof(Instruction));
   dumpByte(D, sizeof(lua_Integer));
@@ -267,7 +345,8 @@ static void dumpHeader (DumpState *D) {
 
 
 /*
-** dump Lua function as precompiled chunk
+** dump Lua function as precompiled chunk ('strip' may have flag
+** LUA_DUMPLAZY, for the lazy format)
 */
 int luaU_dump (lua_State *L, const Proto *f, lua_Writer w, void *data,
                int strip) {
@@ -279,9 +358,17 @@ int luaU_dump (lua_State *L, const Proto *f, lua_Writer w, void *data,
   D.writer = w;
   D.offset = 0;
   D.data = data;
-  D.strip = strip;
+  D.strip = (strip & ~LUA_DUMPLAZY) != 0;
+  D.lazy = (strip & LUA_DUMPLAZY) != 0;
   D.status = 0;
   D.nstr = 0;
+  D.sizes = NULL;
+  D.depth = 0;
+  if (D.lazy) {
+    D.sizes = luaH_new(L);
+    sethvalue2s(L, L->top.p, D.sizes);  /* anchor it */
+    luaD_inctop(L);
+  }
   dumpHeader(&D);
   dumpByte(&D, f->sizeupvalues);
   dumpFunction(&D, f);
@@ -28,6 +28,7 @@ CClosure *luaF_newCclosure (lua_State *L, int nupvals) {
   GCObject *o = luaC_newobj(L, LUA_VCCL, sizeCclosure(nupvals));
   CClosure *c = gco2ccl(o);
   c->nupvalues = cast_byte(nupvals);
+  c->leaf = 0;
   return c;
 }
 
@@ -58,6 +59,54 @@ void luaF_initupvals (lua_State *L, LClosure *cl) {
 }
 
 
+/*
+** {======================================================
+** Index of open upvalues
+** =======================================================
+*/
+
+/*
+** A thread whose list of open upvalues gets long builds an index from
+** stack slots to open upvalues, so that 'luaF_findupval' finds them
+** without walking the list. (The list stays ordered by level, for
+** 'luaF_closeupval'.) The index has the size of the stack; it is
+** dropped whenever the stack is reallocated and rebuilt on demand.
+*/
+
+/* length of a search that makes a thread build its index */
+#if !defined(LUAI_MAXUPVALWALK)
+#define LUAI_MAXUPVALWALK	16
+#endif
+
+
+#define upvalidxsize(L)		cast_sizet(stacksize(L) + EXTRA_STACK)
+
+
+static void buildupvalidx (lua_State *L) {
+  size_t n = upvalidxsize(L);
+  UpVal **idx = cast(UpVal **, luaM_realloc_(L, NULL, 0, n * sizeof(UpVal *)));
+  if (idx != NULL) {  /* else go on without an index */
+    UpVal *uv;
+    size_t i;
+    for (i = 0; i < n; i++)
+      idx[i] = NULL;
+    for (uv = L->openupval; uv != NULL; uv = uv->u.open.next)
+      idx[uplevel(uv) - L->stack.p] = uv;
+    L->upvalidx = idx;
+  }
+}
+
+
+void luaF_freeupvalidx (lua_State *L) {
+  if (L->upvalidx != NULL) {
+    luaM_freearray(L, L->upvalidx, upvalidxsize(L));
+    L->upvalidx = NULL;
+  }
+}
+
+/* }====================================================== */
+
+
 /*
 ** Create a new upvalue at the given level, and link it to the list of
 ** open upvalues of 'L' after entry 'prev'.
@@ -72,6 +121,8 @@ static UpVal *newupval (lua_State *L, StkId level, UpVal **prev) {
   if (next)
     next->u.open.previous = &uv->u.open.next;
   *prev = uv;
+  if (L->upvalidx != NULL)
+    L->upvalidx[level - L->stack.p] = uv;
   if (!isintwups(L)) {  /* thread not in list of threads with upvalues? */
     L->twups = G(L)->twups;  /* link it to the list */
     G(L)->twups = L;
@@ -87,13 +138,21 @@ static UpVal *newupval (lua_State *L, StkId level, UpVal **prev) {
 UpVal *luaF_findupval (lua_State *L, StkId level) {
   UpVal **pp = &L->openupval;
   UpVal *p;
+  int walk = 0;  /* length of the search */
   lua_assert(isintwups(L) || L->openupval == NULL);
+  if (L->upvalidx != NULL && (p = L->upvalidx[level - L->stack.p]) != NULL)
+    return p;  /* found it in the index */
   while ((p = *pp) != NULL && uplevel(p) >= level) {  /* search for it */
     lua_assert(!isdead(G(L), p));
     if (uplevel(p) == level)  /* corresponding upvalue? */
-      return p;  /* return it */
+      break;
     pp = &p->u.open.next;
+    walk++;
   }
+  if (walk >= LUAI_MAXUPVALWALK && L->upvalidx == NULL)
+    buildupvalidx(L);  /* next searches will be faster */
+  if (p != NULL && uplevel(p) == level)
+    return p;  /* return it */
   /* not found: create a new upvalue after 'pp' */
   return newupval(L, level, pp);
 }
@@ -197,6 +256,8 @@ void luaF_closeupval (lua_State *L, StkId level) {
     TValue *slot = &uv->u.value;  /* new position for value */
     lua_assert(uplevel(uv) < L->top.p);
     luaF_unlinkupval(uv);  /* remove upvalue from 'openupval' list */
+    if (L->upvalidx != NULL)
+      L->upvalidx[upl - L->stack.p] = NULL;
     setobj(L, slot, uv->v.p);  /* move value to upvalue slot */
     uv->v.p = slot;  /* now current value lives here */
     if (!iswhite(uv)) {  /* neither white nor dead? */
@@ -260,6 +321,7 @@ Proto *luaF_newproto (lua_State *L) {
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+  f->cache = NULL;
   return f;
 }
 
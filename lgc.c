@@ -93,6 +93,8 @@ constexpr inline int CWUFIN	= 10;
 
 
 static void reallymarkobject (global_State *g, GCObject *o);
+static void ephkeymarked (global_State *g, GCObject *o);
+static void addephdep (global_State *g, GCObject *k, GCObject *v);
 static void atomic (lua_State *L);
 static void entersweep (lua_State *L);
 
@@ -328,6 +330,8 @@ GCObject *luaC_newobj (lua_State *L, lu_byte tt, size_t sz) {
 */
 static void reallymarkobject (global_State *g, GCObject *o) {
   g->GCmarked += cast(l_mem, objsize(o));
+  if (g->ephdeps != NULL)  /* converging ephemerons? */
+    ephkeymarked(g, o);  /* 'o' may be a key with pending values */
   switch (o->tt) {
     case LUA_VSHRSTR:
     case LUA_VLNGSTR: {
@@ -537,8 +541,11 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
       clearkey(n);  /* clear its key */
     else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
       hasclears = 1;  /* table must be cleared */
-      if (valiswhite(gval(n)))  /* value not marked yet? */
+      if (valiswhite(gval(n))) {  /* value not marked yet? */
         hasww = 1;  /* white-white entry */
+        if (g->ephdeps != NULL)  /* converging? */
+          addephdep(g, gckey(n), gcvalue(gval(n)));  /* remember entry */
+      }
     }
     else if (valiswhite(gval(n))) {  /* value not marked yet? */
       marked = 1;
@@ -612,8 +619,15 @@ static l_mem traverseudata (global_State *g, Udata *u) {
 ** arrays can be larger than needed; the extra slots are filled with
 ** NULL, so the use of 'markobjectN')
 */
+/*
+** Traverse a prototype. Its cache is a weak reference: if the cached
+** closure was not marked yet, it is simply dropped. (If the closure
+** is still alive, the next OP_CLOSURE will create a new one.)
+*/
 static l_mem traverseproto (global_State *g, Proto *f) {
   int i;
+  if (f->cache && iswhite(f->cache))
+    f->cache = NULL;  /* allow cache to be collected */
   markobjectN(g, f->source);
   for (i = 0; i < f->sizek; i++)  /* mark literals */
     markvalue(g, &f->k[i]);
@@ -623,6 +637,7 @@ static l_mem traverseproto (global_State *g, Proto *f) {
     markobjectN(g, f->p[i]);
   for (i = 0; i < f->sizelocvars; i++)  /* mark local-variable names */
     markobjectN(g, f->locvars[i].varname);
+  genlink(g, obj2gco(f));  /* its cache may be touched by a barrier */
   return 1 + f->sizek + f->sizeupvalues + f->sizep + f->sizelocvars;
 }
 
@@ -715,13 +730,157 @@ static void propagateall (global_State *g) {
 }
 
 
+/*
+** {======================================================
+** Ephemeron convergence
+** =======================================================
+*/
+
+/*
+** While converging ephemerons, each entry "white key -> white value"
+** found in a traversal is kept in a hash table (indexed by the key).
+** When a key in that table gets marked, it goes to the 'work' list, and
+** the values of all its entries are marked later. So, each entry is
+** visited once, instead of once per iteration of the naive algorithm
+** (which is quadratic on chains of dependencies). If it cannot allocate
+** memory for these structures, the collector falls back to the naive
+** algorithm.
+*/
+typedef struct EphEntry {
+  GCObject *k;  /* white key */
+  GCObject *v;  /* white value */
+} EphEntry;
+
+typedef struct EphDeps {
+  EphEntry *ent;  /* hash table of entries */
+  unsigned int size;  /* size of 'ent' (a power of 2, or 0) */
+  unsigned int n;  /* number of entries in 'ent' */
+  GCObject **work;  /* keys marked after being added to 'ent' */
+  unsigned int sizework;  /* size of 'work' */
+  unsigned int nwork;  /* number of keys in 'work' */
+  int failed;  /* true if some allocation failed */
+} EphDeps;
+
+
+#define ephhash(k,size)  ((point2uint(k) * 2654435769u) >> 3 & ((size) - 1))
+
+
+/*
+** Allocation for the structures above. It runs in the middle of a
+** collection, so it must not raise errors nor run emergency
+** collections.
+*/
+static void *ephrealloc (global_State *g, void *block, size_t osize,
+                                                       size_t nsize) {
+  lu_byte oldstopem = g->gcstopem;
+  void *res;
+  g->gcstopem = 1;  /* no emergency collections while collecting */
+  res = luaM_realloc_(g->mainthread, block, osize, nsize);
+  g->gcstopem = oldstopem;
+  return res;
+}
+
+
+static void ephinsert (EphDeps *d, GCObject *k, GCObject *v) {
+  unsigned int i = ephhash(k, d->size);
+  while (d->ent[i].k != NULL)  /* linear probing */
+    i = (i + 1) & (d->size - 1);
+  d->ent[i].k = k;
+  d->ent[i].v = v;
+  d->n++;
+}
+
+
+/*
+** Add entry 'k' -> 'v' to the table of pending entries, keeping it at
+** most half full.
+*/
+static void addephdep (global_State *g, GCObject *k, GCObject *v) {
+  EphDeps *d = g->ephdeps;
+  if (d->failed)
+    return;  /* naive algorithm will do the work */
+  if (2 * (d->n + 1) > d->size) {  /* table too full? */
+    EphEntry *old = d->ent;
+    unsigned int oldsize = d->size;
+    unsigned int newsize = (oldsize == 0) ? 64 : 2 * oldsize;
+    unsigned int i;
+    d->ent = cast(EphEntry *, ephrealloc(g, NULL, 0,
+                                    newsize * sizeof(EphEntry)));
+    if (d->ent == NULL || newsize <= oldsize) {  /* error or overflow? */
+      d->ent = old;  /* keep the old table, to be freed later */
+      d->failed = 1;
+      return;
+    }
+    d->size = newsize;
+    d->n = 0;
+    for (i = 0; i < newsize; i++)
+      d->ent[i].k = NULL;
+    for (i = 0; i < oldsize; i++) {  /* reinsert old entries */
+      if (old[i].k != NULL)
+        ephinsert(d, old[i].k, old[i].v);
+    }
+    ephrealloc(g, old, oldsize * sizeof(EphEntry), 0);
+  }
+  ephinsert(d, k, v);
+}
+
+
+static int ephcontains (EphDeps *d, GCObject *k) {
+  if (d->n > 0) {
+    unsigned int i = ephhash(k, d->size);
+    for (; d->ent[i].k != NULL; i = (i + 1) & (d->size - 1)) {
+      if (d->ent[i].k == k)
+        return 1;
+    }
+  }
+  return 0;
+}
+
+
+/*
+** Object 'o' is being marked; if it is the key of pending entries,
+** their values must be marked too. (That cannot be done here, as it
+** would recurse along chains of entries.)
+*/
+static void ephkeymarked (global_State *g, GCObject *o) {
+  EphDeps *d = g->ephdeps;
+  if (d->failed || !ephcontains(d, o))
+    return;  /* nothing to be done */
+  if (d->nwork == d->sizework) {  /* work list is full? */
+    unsigned int newsize = (d->sizework == 0) ? 32 : 2 * d->sizework;
+    GCObject **w = cast(GCObject **, ephrealloc(g, d->work,
+                           d->sizework * sizeof(GCObject *),
+                           newsize * sizeof(GCObject *)));
+    if (w == NULL || newsize <= d->sizework) {  /* error or overflow? */
+      d->failed = 1;
+      return;
+    }
+    d->work = w;
+    d->sizework = newsize;
+  }
+  d->work[d->nwork++] = o;
+}
+
+
+/*
+** Mark the values of all pending entries with key 'k'.
+*/
+static void markephvalues (global_State *g, EphDeps *d, GCObject *k) {
+  unsigned int i = ephhash(k, d->size);
+  for (; d->ent[i].k != NULL; i = (i + 1) & (d->size - 1)) {
+    if (d->ent[i].k == k && iswhite(d->ent[i].v))
+      reallymarkobject(g, d->ent[i].v);
+  }
+}
+
+
 /*
 ** Traverse all ephemeron tables propagating marks from keys to values.
 ** Repeat until it converges, that is, nothing new is marked. 'dir'
 ** inverts the direction of the traversals, trying to speed up
 ** convergence on chains in the same table.
 */
-static void convergeephemerons (global_State *g) {
+static void iterateephemerons (global_State *g) {
   int changed;
   int dir = 0;
   do {
@@ -742,6 +901,43 @@ static void convergeephemerons (global_State *g) {
   } while (changed);  /* repeat until no more changes */
 }
 
+
+/*
+** Propagate marks from keys to values in all ephemeron tables. Each
+** table is traversed once, collecting its white->white entries; marks
+** are then propagated through the collected entries as their keys get
+** marked. Tables with white->white entries go back to the 'ephemeron'
+** list; at the end, their remaining white keys are dead.
+*/
+static void convergeephemerons (global_State *g) {
+  EphDeps d;
+  GCObject *w;
+  GCObject *next = g->ephemeron;  /* get ephemeron list */
+  g->ephemeron = NULL;  /* tables may return to this list when traversed */
+  d.ent = NULL; d.size = d.n = 0;
+  d.work = NULL; d.sizework = d.nwork = 0;
+  d.failed = 0;
+  g->ephdeps = &d;
+  while ((w = next) != NULL) {  /* for each ephemeron table */
+    Table *h = gco2t(w);
+    next = h->gclist;  /* list is rebuilt during loop */
+    nw2black(h);  /* out of the list (for now) */
+    traverseephemeron(g, h, 0);
+  }
+  do {
+    propagateall(g);  /* may find (and traverse) new ephemeron tables */
+    while (d.nwork > 0 && !d.failed)
+      markephvalues(g, &d, d.work[--d.nwork]);
+  } while (g->gray != NULL);
+  g->ephdeps = NULL;
+  ephrealloc(g, d.ent, d.size * sizeof(EphEntry), 0);
+  ephrealloc(g, d.work, d.sizework * sizeof(GCObject *), 0);
+  if (d.failed)  /* could not keep track of all entries? */
+    iterateephemerons(g);  /* finish the work the naive way */
+}
+
+/* }====================================================== */
+
 /* }====================================================== */
 
 
@@ -970,6 +1166,21 @@ static void callallpendingfinalizers (lua_State *L) {
 }
 
 
+/*
+** Call at most 'n' pending finalizers (all of them if 'n' is negative)
+** and return how many were called. When 'g->gcdeferfin' is true, the
+** collector leaves objects in 'tobefnz' and this is the only way to
+** finalize them, except for 'luaC_freeallobjects'.
+*/
+int luaC_runfinalizers (lua_State *L, int n) {
+  global_State *g = G(L);
+  int i;
+  for (i = 0; g->tobefnz && (n < 0 || i < n); i++)
+    GCTM(L);
+  return i;
+}
+
+
 /*
 ** find last 'next' field in list 'p' list (to add elements in its end)
 */
@@ -1260,7 +1471,7 @@ static void finishgencycle (lua_State *L, global_State *g) {
   correctgraylists(g);
   checkSizes(L, g);
   g->gcstate = GCSpropagate;  /* skip restart */
-  if (!g->gcemergency)
+  if (!g->gcemergency && !g->gcdeferfin)
     callallpendingfinalizers(L);
 }
 
@@ -1634,12 +1845,12 @@ static l_mem singlestep (lua_State *L, int fast) {
       break;
     }
     case GCScallfin: {  /* call finalizers */
-      if (g->tobefnz && !g->gcemergency) {
+      if (g->tobefnz && !g->gcemergency && !g->gcdeferfin) {
         g->gcstopem = 0;  /* ok collections during finalizers */
         GCTM(L);  /* call one finalizer */
         stepresult = CWUFIN;
       }
-      else {  /* emergency mode or no more finalizers */
+      else {  /* emergency mode, deferred finalizers, or no more of them */
         g->gcstate = GCSpause;  /* finish collection */
         stepresult = step2pause;
       }
@@ -42,6 +42,7 @@ static const luaL_Reg stdlibs[] = {
   {LUA_STRLIBNAME, luaopen_string},
   {LUA_TABLIBNAME, luaopen_table},
   {LUA_UTF8LIBNAME, luaopen_utf8},
+  {LUA_SCHEDLIBNAME, luaopen_sched},
   {NULL, NULL}
 };
 
@@ -63,7 +64,7 @@ LUALIB_API void luaL_openselectedlibs (lua_State *L, int load, int preload) {
       lua_setfield(L, -2, lib->name);  /* add library to PRELOAD table */
     }
   }
-  lua_assert((mask >> 1) == LUA_UTF8LIBK);
+  lua_assert((mask >> 1) == LUA_SCHEDLIBK);
   lua_pop(L, 1);  /* remove PRELOAD table */
 }
 
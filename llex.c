@@ -72,6 +72,25 @@ static void save (LexState *ls, int c) {
 LUA_INL void save_and_next(LexState* ls) { save(ls, ls->current); next(ls); }
 
 
+/*
+** Save the 'l' characters at 's' in the buffer at once.
+*/
+static void savebulk (LexState *ls, const char *s, size_t l) {
+  Mbuffer *b = ls->buff;
+  if (l > luaZ_sizebuffer(b) - luaZ_bufflen(b)) {
+    size_t newsize = luaZ_sizebuffer(b);
+    do {
+      if (newsize >= MAX_SIZE/2)
+        lexerror(ls, "lexical element too long", 0);
+      newsize *= 2;
+    } while (l > newsize - luaZ_bufflen(b));
+    luaZ_resizebuffer(ls->L, b, newsize);
+  }
+  memcpy(b->buffer + luaZ_bufflen(b), s, l);
+  luaZ_bufflen(b) += l;
+}
+
+
 void luaX_init (lua_State *L) {
   int i;
   TString *e = luaS_newliteral(L, LUA_ENV);  /* create env name */
@@ -186,6 +205,87 @@ void luaX_setinput (lua_State *L, LexState *ls, ZIO *z, TString *source,
 
 
 
+/*
+** {======================================================
+** Bulk scanning: inside comments and strings, runs of characters with
+** no special meaning there are taken directly from the buffer of the
+** input stream, instead of one by one through 'next'. The search for
+** the end of a run tests a word of characters at a time.
+** =======================================================
+*/
+
+/* a word with all bytes equal to 1, and with all high bits set */
+#define BYTES1		(~cast_sizet(0) / 0xFF)
+#define BYTESHIGH	(BYTES1 << 7)
+
+/* true if some byte of word 'w' is zero (can give false positives
+   only above a zero byte) */
+#define haszerobyte(w)	(((w) - BYTES1) & ~(w) & BYTESHIGH)
+
+
+/*
+** Length of the initial run of 's' (with 'n' characters) with none of
+** the characters 'c1' to 'c4'.
+*/
+static size_t plainlen (const char *s, size_t n, int c1, int c2, int c3,
+                        int c4) {
+  const size_t m1 = BYTES1 * cast_uchar(c1), m2 = BYTES1 * cast_uchar(c2);
+  const size_t m3 = BYTES1 * cast_uchar(c3), m4 = BYTES1 * cast_uchar(c4);
+  size_t i = 0;
+  for (; n - i >= sizeof(size_t); i += sizeof(size_t)) {
+    size_t w;
+    memcpy(&w, s + i, sizeof(w));
+    if (haszerobyte(w ^ m1) | haszerobyte(w ^ m2) |
+        haszerobyte(w ^ m3) | haszerobyte(w ^ m4))
+      break;  /* some stop character in this word */
+  }
+  for (; i < n; i++) {
+    int c = cast_uchar(s[i]);
+    if (c == c1 || c == c2 || c == c3 || c == c4)
+      break;
+  }
+  return i;
+}
+
+
+/*
+** Go past the current character and the run of characters after it,
+** in the current block of the stream, that are not any of 'c1' to
+** 'c4', saving them all if 'keep'.
+*/
+static void plainrun (LexState *ls, int keep, int c1, int c2, int c3,
+                      int c4) {
+  ZIO *z = ls->z;
+  size_t l = plainlen(z->p, z->n, c1, c2, c3, c4);
+  lua_assert(ls->current != EOZ);
+  if (keep) {
+    save(ls, ls->current);
+    savebulk(ls, z->p, l);
+  }
+  z->p += l;
+  z->n -= l;
+  next(ls);
+}
+
+
+/*
+** Go past the current character and the run of spaces and tabs after
+** it in the current block of the stream.
+*/
+static void skipblanks (LexState *ls) {
+  ZIO *z = ls->z;
+  size_t l = 0;
+  while (l < z->n && (z->p[l] == ' ' || z->p[l] == '\t'))
+    l++;
+  z->p += l;
+  z->n -= l;
+  next(ls);
+}
+
+/* }====================================================== */
+
+
+
 /*
 ** =======================================================
 ** LEXICAL ANALYZER
@@ -310,8 +410,7 @@ static void read_long_string (LexState *ls, SemInfo *seminfo, size_t sep) {
         break;
       }
       default: {
-        if (seminfo) save_and_next(ls);
-        else next(ls);
+        plainrun(ls, seminfo != NULL, ']', '\n', '\r', ']');
       }
     }
   } endloop:
@@ -438,7 +537,7 @@ static void read_string (LexState *ls, int del, SemInfo *seminfo) {
        no_save: break;
       }
       default:
-        save_and_next(ls);
+        plainrun(ls, 1, del, '\\', '\n', '\r');
     }
   }
   save_and_next(ls);  /* skip delimiter */
@@ -456,7 +555,7 @@ static int llex (LexState *ls, SemInfo *seminfo) {
         break;
       }
       case ' ': case '\f': case '\t': case '\v': {  /* spaces */
-        next(ls);
+        skipblanks(ls);
         break;
       }
       case '-': {  /* '-' or '--' (comment) */
@@ -473,9 +572,9 @@ static int llex (LexState *ls, SemInfo *seminfo) {
             break;
           }
         }
-        /* else short comment */
+        /* else short comment: skip until end of line (or end of file) */
         while (!currIsNewline(ls) && ls->current != EOZ)
-          next(ls);  /* skip until end of line (or end of file) */
+          plainrun(ls, 0, '\n', '\r', '\n', '\r');
         break;
       }
       case '[': {  /* long string or simply '[' */
@@ -551,7 +650,7 @@ static int llex (LexState *ls, SemInfo *seminfo) {
                                   luaZ_bufflen(ls->buff));
           seminfo->ts = ts;
           if (isreserved(ts))  /* reserved word? */
-            return ts->extra - 1 + FIRST_RESERVED;
+            return (ts->extra & ~WATCHEDKEY) - 1 + FIRST_RESERVED;
           else {
             return TK_NAME;
           }
@@ -75,6 +75,10 @@ typedef struct LexState {
   struct Dyndata *dyd;  /* dynamic structures used by the parser */
   TString *source;      /* current source name */
   TString *envn;        /* environment variable name */
+  lu_byte lazy;         /* skim function bodies, to compile them later */
+  lu_byte optimize;     /* run the optimizer over the generated code */
+  lu_byte hoist;        /* hoist loads out of numeric loops */
+  lu_byte inlining;     /* expand calls to small local functions */
 } LexState;
 
 
@@ -636,6 +636,22 @@ static const luaL_Reg randfuncs[] = {
 };
 
 
+/*
+** functions called directly by the interpreter (see 'lua_pushleaf')
+*/
+static const luaL_Leaf mathleaves[] = {
+  {"abs",   math_abs, 1},
+  {"ceil",  math_ceil, 1},
+  {"cos",   math_cos, 1},
+  {"tointeger", math_toint, 1},
+  {"floor", math_floor, 1},
+  {"fmod",   math_fmod, 2},
+  {"sin",   math_sin, 1},
+  {"sqrt",  math_sqrt, 1},
+  {NULL, NULL, 0}
+};
+
+
 /*
 ** Register the random functions and initialize their state.
 */
@@ -703,25 +719,17 @@ static int math_log10 (lua_State *L) {
 
 
 static const luaL_Reg mathlib[] = {
-  {"abs",   math_abs},
   {"acos",  math_acos},
   {"asin",  math_asin},
   {"atan",  math_atan},
-  {"ceil",  math_ceil},
-  {"cos",   math_cos},
   {"deg",   math_deg},
   {"exp",   math_exp},
-  {"tointeger", math_toint},
-  {"floor", math_floor},
-  {"fmod",   math_fmod},
   {"ult",   math_ult},
   {"log",   math_log},
   {"max",   math_max},
   {"min",   math_min},
   {"modf",   math_modf},
   {"rad",   math_rad},
-  {"sin",   math_sin},
-  {"sqrt",  math_sqrt},
   {"tan",   math_tan},
   {"type", math_type},
 #if defined(LUA_COMPAT_MATHLIB)
@@ -750,6 +758,7 @@ static const luaL_Reg mathlib[] = {
 */
 LUAMOD_API int luaopen_math (lua_State *L) {
   luaL_newlib(L, mathlib);
+  luaL_setleaves(L, mathleaves);
   lua_pushnumber(L, PI);
   lua_setfield(L, -2, "pi");
   lua_pushnumber(L, (lua_Number)HUGE_VAL);
@@ -41,11 +41,97 @@
 */
 
 
+/*
+** {==================================================================
+** Large-object space
+** ===================================================================
+*/
+#if defined(LUA_USE_LOSPACE) && defined(LUA_USE_POSIX)	/* { */
+
+#include <string.h>
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+/*
+** Large blocks are mapped directly from the system, so that they do
+** not fragment the heap of the allocation function and their pages go
+** back to the system as soon as they are freed. Lua always gives the
+** correct old size of a block, so that size alone tells whether the
+** block is a mapping or belongs to the allocation function. (The
+** kernel rounds all sizes to whole pages.)
+*/
+static void *lomap (size_t size) {
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return (p == MAP_FAILED) ? NULL : p;
+}
+
+
+/*
+** Reallocate a block when the old or the new size is large. 'os' is
+** the old size of 'block', or an object tag when 'block' is NULL.
+*/
+static void *lorealloc (global_State *g, void *block, size_t os,
+                                                      size_t ns) {
+  void *newblock;
+  if (block == NULL || !luaM_islarge(os)) {  /* new mapping? */
+    lua_assert(luaM_islarge(ns));
+    newblock = lomap(ns);
+    if (newblock != NULL && block != NULL) {  /* coming from the heap? */
+      memcpy(newblock, block, os);
+      (*g->frealloc)(g->ud, block, os, 0);
+    }
+  }
+  else if (ns == 0) {  /* freeing a mapping? */
+    munmap(block, os);
+    newblock = NULL;
+  }
+  else if (!luaM_islarge(ns)) {  /* moving back to the heap? */
+    newblock = (*g->frealloc)(g->ud, NULL, 0, ns);
+    if (newblock != NULL) {
+      memcpy(newblock, block, ns);
+      munmap(block, os);
+    }
+  }
+  else {  /* resizing a mapping */
+#if defined(MREMAP_MAYMOVE)
+    newblock = mremap(block, os, ns, MREMAP_MAYMOVE);
+    if (newblock == MAP_FAILED)
+      newblock = NULL;
+#else
+    newblock = lomap(ns);
+    if (newblock != NULL) {
+      memcpy(newblock, block, (os < ns) ? os : ns);
+      munmap(block, os);
+    }
+#endif
+  }
+  return newblock;
+}
+
+
+/*
+** Macro to call the allocation function.
+*/
+#define callfrealloc(g,block,os,ns)  \
+  ((luaM_islarge(ns) || (block != NULL && luaM_islarge(os)))  \
+     ? lorealloc(g, block, os, ns)  \
+     : (*g->frealloc)(g->ud, block, os, ns))
+
+#else						/* }{ */
+
 /*
 ** Macro to call the allocation function.
 */
 #define callfrealloc(g,block,os,ns)    ((*g->frealloc)(g->ud, block, os, ns))
 
+#endif						/* } */
+
+/* }================================================================== */
+
 
 /*
 ** When an allocation fails, it will try again after an emergency
@@ -58,6 +144,22 @@
 #define cantryagain(g)	(completestate(g) && !g->gcstopem)
 
 
+/*
+** Check whether growing a block from 'os' to 'ns' bytes would take the
+** total allocated memory beyond the hard limit 'g->GClimit'. Without
+** a limit, 'GClimit' is MAX_LMEM, so the test never succeeds. ('room'
+** can be negative when the limit was set below the current usage.)
+*/
+static int overlimit (global_State *g, size_t os, size_t ns) {
+  if (ns <= os)
+    return 0;  /* shrinking or freeing a block never fails */
+  else {
+    l_mem room = g->GClimit - gettotalbytes(g);
+    return (room < 0 || cast_sizet(room) < ns - os);
+  }
+}
+
+
 
 
 #if defined(EMERGENCYGCTESTS)
@@ -155,18 +257,39 @@ void luaM_free_ (lua_State *L, void *block, size_t osize) {
 }
 
 
+/*
+** First attempt of an allocation: a request that would exceed the
+** memory limit fails as if the allocation function had failed.
+** ('os' is the old size of the block, which is zero for new objects.)
+*/
+#define limitedtry(g,block,os,ns,bs)  \
+	(overlimit(g, os, ns) ? NULL : firsttry(g, block, bs, ns))
+
+
 /*
 ** In case of allocation fail, this function will do an emergency
 ** collection to free some memory and then try the allocation again.
+** If the allocation still does not fit in the memory limit, it fails
+** without calling the allocation function. ('bsize' is what must be
+** passed to the allocation function as the old size of the block:
+** either 'osize' or the tag of a new object.)
 */
 static void *tryagain (lua_State *L, void *block,
-                       size_t osize, size_t nsize) {
+                       size_t osize, size_t nsize, size_t bsize) {
   global_State *g = G(L);
   if (cantryagain(g)) {
     luaC_fullgc(L, 1);  /* try to free some memory... */
-    return callfrealloc(g, block, osize, nsize);  /* try again */
+    if (l_unlikely(overlimit(g, osize, nsize))) {
+      g->GClimithits++;
+      return NULL;  /* still above the limit */
+    }
+    return callfrealloc(g, block, bsize, nsize);  /* try again */
+  }
+  else {
+    if (overlimit(g, osize, nsize))
+      g->GClimithits++;
+    return NULL;  /* cannot run an emergency collection */
   }
-  else return NULL;  /* cannot run an emergency collection */
 }
 
 
@@ -177,9 +300,9 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   void *newblock;
   global_State *g = G(L);
   lua_assert((osize == 0) == (block == NULL));
-  newblock = firsttry(g, block, osize, nsize);
+  newblock = limitedtry(g, block, osize, nsize, osize);
   if (l_unlikely(newblock == NULL && nsize > 0)) {
-    newblock = tryagain(L, block, osize, nsize);
+    newblock = tryagain(L, block, osize, nsize, osize);
     if (newblock == NULL)  /* still no memory? */
       return NULL;  /* do not update 'GCdebt' */
   }
@@ -203,9 +326,9 @@ void *luaM_malloc_ (lua_State *L, size_t size, int tag) {
     return NULL;  /* that's all */
   else {
     global_State *g = G(L);
-    void *newblock = firsttry(g, NULL, cast_sizet(tag), size);
+    void *newblock = limitedtry(g, NULL, 0, size, cast_sizet(tag));
     if (l_unlikely(newblock == NULL)) {
-      newblock = tryagain(L, NULL, cast_sizet(tag), size);
+      newblock = tryagain(L, NULL, 0, size, cast_sizet(tag));
       if (newblock == NULL)
         luaM_error(L);
     }
@@ -213,3 +336,20 @@ void *luaM_malloc_ (lua_State *L, size_t size, int tag) {
     return newblock;
   }
 }
+
+
+/*
+** Account for a block of memory that changed from 'osize' to 'nsize'
+** bytes without the allocation function (e.g., stacks in reserved
+** space). Growing the block fails, returning false, if it would go
+** beyond the memory limit; there is no emergency collection here.
+*/
+int luaM_account (lua_State *L, size_t osize, size_t nsize) {
+  global_State *g = G(L);
+  if (l_unlikely(overlimit(g, osize, nsize))) {
+    g->GClimithits++;
+    return 0;
+  }
+  g->GCdebt -= cast(l_mem, nsize) - cast(l_mem, osize);
+  return 1;
+}
@@ -17,6 +17,17 @@
 #define luaM_error(L)	luaD_throw(L, LUA_ERRMEM)
 
 
+/*
+** Blocks with at least LUAI_LOSPACEMIN bytes are "large objects". When
+** LUA_USE_LOSPACE is on, they live in their own mappings (see 'lmem.c').
+*/
+#if !defined(LUAI_LOSPACEMIN)
+#define LUAI_LOSPACEMIN		(128 * 1024)
+#endif
+
+#define luaM_islarge(s)		((s) >= LUAI_LOSPACEMIN)
+
+
 /*
 ** This macro tests whether it is safe to multiply 'n' by the size of
 ** type 't' without overflows. Because 'e' is always constant, it avoids
@@ -90,6 +101,7 @@ LUAI_FUNC void *luaM_growaux_ (lua_State *L, void *block, int nelems,
 LUAI_FUNC void *luaM_shrinkvector_ (lua_State *L, void *block, int *nelem,
                                     int final_n, unsigned size_elem);
 LUAI_FUNC void *luaM_malloc_ (lua_State *L, size_t size, int tag);
+LUAI_FUNC int luaM_account (lua_State *L, size_t osize, size_t nsize);
 
 #endif
 
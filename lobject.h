@@ -500,7 +500,8 @@ constexpr inline int LSTRMEM = -3;  /* external long string with deallocation */
 typedef struct TString
 {
 	CommonHeader;
-	lu_byte extra;  /* reserved words for short strings; "has hash" for longs */
+	lu_byte extra;  /* reserved words and watched keys for short strings;
+	                   "has hash" for longs */
 	ls_byte shrlen;  /* length for short strings, negative for long strings */
 	unsigned int hash;
 	union
@@ -698,10 +699,20 @@ typedef struct AbsLineInfo
 */
 constexpr inline int PF_ISVARARG = 1;
 constexpr inline int PF_FIXED = 2;  /* prototype has parts in fixed memory */
+constexpr inline int PF_LAZY = 4;  /* prototype body not loaded yet */
+constexpr inline int PF_LAZYTEXT = 8;  /* prototype not compiled yet */
+constexpr inline int PF_OPTIMIZE = 16;  /* optimize it when compiled */
+constexpr inline int PF_HOIST = 32;  /* hoist loads out of loops when compiled */
 
 
 /*
 ** Function Prototypes
+** (A lazy prototype, with flag PF_LAZY, has only 'source'; 'lineinfo'
+** holds its encoded body, with 'sizelineinfo' bytes. See 'lundump.c'.
+** A prototype with flag PF_LAZYTEXT has also 'numparams' and the
+** 'upvalues' of the function, but 'lineinfo' holds its source text
+** and 'k' holds pairs name-value of the compile-time constants it
+** uses. See 'lparser.c'.)
 */
 typedef struct Proto
 {
@@ -726,6 +737,7 @@ typedef struct Proto
 	AbsLineInfo* abslineinfo;  /* idem */
 	LocVar* locvars;  /* information about local variables (debug information) */
 	TString* source;  /* used for debug information */
+	struct LClosure* cache;  /* last-created closure with this prototype */
 	GCObject* gclist;
 } Proto;
 
@@ -762,6 +774,7 @@ typedef struct UpVal
 typedef struct CClosure
 {
 	ClosureHeader;
+	lu_byte leaf;  /* number of arguments + 1 of a leaf (0 if not a leaf) */
 	lua_CFunction f;
 	TValue upvalue[1];  /* list of upvalues */
 } CClosure;
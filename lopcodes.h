@@ -268,11 +268,14 @@ OP_VARARG,/*	A C	R[A], R[A+1], ..., R[A+C-2] = vararg		*/
 
 OP_VARARGPREP,/*A	(adjust vararg parameters)			*/
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+OP_HOISTCHECK/*	A sBx	if R[A] ~= hoist epoch then
+				{ R[A] := hoist epoch; pc += sBx }	*/
 } OpCode;
 
 
-constexpr inline int NUM_OPCODES = ((int)(OP_EXTRAARG)+1);
+constexpr inline int NUM_OPCODES = ((int)(OP_HOISTCHECK)+1);
 
 
 /*
@@ -420,6 +423,11 @@ LUA_CEXP Instruction& SETARG_A(Instruction& i, int v) {
   original operand was a float. (It must be corrected in case of
   metamethods.)
 
+  (*) OP_HOISTCHECK starts the body of a numeric loop whose loads were
+  hoisted (see 'luaK_hoist'). The hoist epoch changes with every store
+  into a key of a hoisted load; when R[A] does not have the current
+  epoch, the jump goes to code that redoes the loads and jumps back.
+
 ===========================================================================*/
 
 
@@ -96,6 +96,7 @@ static const char *const opnames[] = {
   "VARARG",
   "VARARGPREP",
   "EXTRAARG",
+  "HOISTCHECK",
   NULL
 };
 
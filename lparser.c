@@ -15,6 +15,7 @@
 
 #include "lua.h"
 
+#include "lapi.h"
 #include "lcode.h"
 #include "ldebug.h"
 #include "ldo.h"
@@ -202,6 +203,7 @@ static int new_localvarkind (LexState *ls, TString *name, lu_byte kind) {
                   dyd->actvar.size, Vardesc, SHRT_MAX, "local variables");
   var = &dyd->actvar.arr[dyd->actvar.n++];
   var->vd.kind = kind;  /* default */
+  var->vd.pfunc = -1;
   var->vd.name = name;
   return dyd->actvar.n - 1 - fs->firstlocal;
 }
@@ -295,6 +297,7 @@ static void check_readonly (LexState *ls, expdesc *e) {
       Vardesc *vardesc = getlocalvardesc(fs, e->u.var.vidx);
       if (vardesc->vd.kind != VDKREG)  /* not a regular variable? */
         varname = vardesc->vd.name;
+      vardesc->vd.pfunc = -1;  /* variable will not keep its function */
       break;
     }
     case VUPVAL: {
@@ -745,6 +748,7 @@ static void open_func (LexState *ls, FuncState *fs, BlockCnt *bl) {
   fs->previousline = f->linedefined;
   fs->iwthabs = 0;
   fs->lasttarget = 0;
+  fs->hoistcheck = NO_JUMP;
   fs->freereg = 0;
   fs->nk = 0;
   fs->nabslineinfo = 0;
@@ -771,6 +775,8 @@ static void close_func (LexState *ls) {
   leaveblock(fs);
   lua_assert(fs->bl == NULL);
   luaK_finish(fs);
+  if (ls->optimize)
+    luaK_optimize(fs);
   luaM_shrinkvector(L, f->code, f->sizecode, fs->pc, Instruction);
   luaM_shrinkvector(L, f->lineinfo, f->sizelineinfo, fs->pc, ls_byte);
   luaM_shrinkvector(L, f->abslineinfo, f->sizeabslineinfo,
@@ -1014,10 +1020,228 @@ static void parlist (LexState *ls) {
 }
 
 
+/*
+** {======================================================================
+** Lazy compilation: when 'ls->lazy' is set, the body of a function is
+** only skimmed; its text is kept in the prototype (flagged PF_LAZYTEXT)
+** and compiled by 'luaY_parselazy' when the function is first called.
+** Skimming finds the end of the body and resolves every name in it as
+** a variable, so that the function captures all upvalues it may need
+** (maybe a few more) and records the values of all compile-time
+** constants it may use.
+** =======================================================================
+*/
+
+
+typedef struct SkimReader {
+  lua_Reader reader;  /* original reader of the stream */
+  void *data;  /* its data */
+  LexState *ls;
+  const char *start;  /* part of current block not saved yet */
+} SkimReader;
+
+
+static void skimsave (LexState *ls, const char *s, size_t l) {
+  Dyndata *dyd = ls->dyd;
+  while (l > cast_sizet(dyd->skim.size - dyd->skim.n))
+    luaM_growvector(ls->L, dyd->skim.arr, dyd->skim.size, dyd->skim.size,
+                    char, INT_MAX, "characters in a function");
+  memcpy(dyd->skim.arr + dyd->skim.n, s, l);
+  dyd->skim.n += cast_int(l);
+}
+
+
+/*
+** Reader that saves each block of the stream before reading the next.
+*/
+static const char *skimreader (lua_State *L, void *ud, size_t *size) {
+  SkimReader *sr = cast(SkimReader *, ud);
+  ZIO *z = sr->ls->z;
+  const char *b;
+  lua_lock(L);
+  skimsave(sr->ls, sr->start, cast_sizet(z->p - sr->start));
+  lua_unlock(L);
+  b = sr->reader(L, sr->data, size);
+  sr->start = (b == NULL || *size == 0) ? z->p : b;
+  return b;
+}
+
+
+/*
+** Keep the value of compile-time constant 'vd' in the function being
+** skimmed, as a pair name-value in its 'k'.
+*/
+static void skimconst (FuncState *fs, Vardesc *vd) {
+  lua_State *L = fs->ls->L;
+  Proto *f = fs->f;
+  int oldsize = f->sizek;
+  int i;
+  for (i = 0; i < fs->nk; i += 2) {
+    if (eqstr(tsvalue(&f->k[i]), vd->vd.name))
+      return;  /* already there */
+  }
+  luaM_growvector(L, f->k, fs->nk + 1, f->sizek, TValue, MAXARG_Ax,
+                  "constants");
+  while (oldsize < f->sizek)
+    setnilvalue(&f->k[oldsize++]);
+  setsvalue(L, &f->k[fs->nk], vd->vd.name);
+  luaC_barrier(L, f, &f->k[fs->nk]);
+  setobj(L, &f->k[fs->nk + 1], &vd->k);
+  luaC_barrier(L, f, &f->k[fs->nk + 1]);
+  fs->nk += 2;
+}
+
+
+static void skimname (LexState *ls, TString *name) {
+  FuncState *fs = ls->fs;
+  expdesc var;
+  singlevaraux(fs, name, &var, 1);
+  if (var.k == VVOID)  /* global name? */
+    singlevaraux(fs, ls->envn, &var, 1);  /* needs environment variable */
+  if (var.k == VCONST)
+    skimconst(fs, &ls->dyd->actvar.arr[var.u.info]);
+}
+
+
+/* states of 'skimbody' while reading lists of declared names */
+constexpr inline int SK_NONE = 0;  /* names are variables */
+constexpr inline int SK_DECL = 1;  /* next name is being declared */
+constexpr inline int SK_AFTER = 2;  /* after a declared name */
+constexpr inline int SK_ATTRIB = 3;  /* inside an attribute */
+
+
+/*
+** Skim the body of a function up to its 'end', saving its text preceded
+** by the parameter list. Newlines keep the body in its original lines.
+** The current token is the ')' closing the parameter list. Names being
+** declared (after 'local', 'for', or in a parameter list), fields,
+** and labels are not variables.
+*/
+static void skimbody (LexState *ls, int line) {
+  FuncState *fs = ls->fs;
+  ZIO *z = ls->z;
+  SkimReader sr;
+  int depth = 1;  /* open blocks */
+  int prev = ')';  /* previous token */
+  int state = SK_NONE;
+  int params = 0;  /* next '(' opens a parameter list */
+  int inlabel = 0;
+  int i;
+  ls->dyd->skim.n = 0;
+  skimsave(ls, "(", 1);
+  for (i = 0; i < fs->nactvar; i++) {
+    TString *name = getlocalvardesc(fs, i)->vd.name;
+    if (i > 0) skimsave(ls, ",", 1);
+    skimsave(ls, getstr(name), tsslen(name));
+  }
+  if (fs->f->flag & PF_ISVARARG)
+    skimsave(ls, (i > 0) ? ",..." : "...", (i > 0) ? 4 : 3);
+  for (i = line; i < ls->linenumber; i++)
+    skimsave(ls, "\n", 1);
+  skimsave(ls, ")", 1);
+  if (ls->current != EOZ) {
+    char c = cast_char(ls->current);
+    skimsave(ls, &c, 1);
+  }
+  sr.reader = z->reader; sr.data = z->data;
+  sr.ls = ls; sr.start = z->p;
+  z->reader = skimreader; z->data = &sr;
+  do {
+    int t;
+    luaX_next(ls);
+    t = ls->t.token;
+    if (state == SK_DECL && (t == TK_NAME || t == TK_DOTS))
+      state = SK_AFTER;
+    else if (state == SK_AFTER && (t == ',' || t == '<'))
+      state = (t == ',') ? SK_DECL : SK_ATTRIB;
+    else if (state == SK_ATTRIB && (t == TK_NAME || t == '>'))
+      state = (t == '>') ? SK_AFTER : SK_ATTRIB;
+    else {
+      state = SK_NONE;
+      switch (t) {
+        case TK_FUNCTION:
+          if (prev == TK_LOCAL)
+            state = SK_DECL;
+          params = 1;
+          depth++;
+          break;
+        case '(':
+          if (params)
+            state = SK_DECL;
+          params = 0;
+          break;
+        case TK_LOCAL: case TK_FOR:
+          state = SK_DECL;
+          break;
+        case TK_DO: case TK_IF: case TK_REPEAT:
+          depth++;
+          break;
+        case TK_END: case TK_UNTIL:
+          depth--;
+          break;
+        case TK_EOS:
+          depth = 0;
+          break;
+        case TK_DBCOLON:
+          inlabel = !inlabel;
+          break;
+        case TK_NAME:
+          if (!(prev == '.' || prev == ':' || prev == TK_GOTO ||
+               (prev == TK_DBCOLON && inlabel)))
+            skimname(ls, ls->t.seminfo.ts);
+          break;
+        default: break;
+      }
+    }
+    prev = t;
+  } while (depth > 0);
+  z->reader = sr.reader; z->data = sr.data;
+  /* save the rest of the block, but not the look-ahead character */
+  skimsave(ls, sr.start, cast_sizet(z->p - sr.start) - (ls->current != EOZ));
+}
+
+
+/*
+** Finish a skimmed function: discard the code and debug information
+** generated for its parameters and keep the text saved by 'skimbody'.
+*/
+static void close_lazy (LexState *ls) {
+  lua_State *L = ls->L;
+  FuncState *fs = ls->fs;
+  Proto *f = fs->f;
+  Dyndata *dyd = ls->dyd;
+  leaveblock(fs);
+  lua_assert(fs->bl == NULL && fs->np == 0);
+  luaM_freearray(L, f->code, cast_sizet(f->sizecode));
+  f->code = NULL; f->sizecode = 0;
+  luaM_freearray(L, f->abslineinfo, cast_sizet(f->sizeabslineinfo));
+  f->abslineinfo = NULL; f->sizeabslineinfo = 0;
+  luaM_freearray(L, f->locvars, cast_sizet(f->sizelocvars));
+  f->locvars = NULL; f->sizelocvars = 0;
+  luaM_freearray(L, f->lineinfo, cast_sizet(f->sizelineinfo));
+  f->lineinfo = NULL; f->sizelineinfo = 0;
+  f->lineinfo = luaM_newvectorchecked(L, dyd->skim.n, ls_byte);
+  memcpy(f->lineinfo, dyd->skim.arr, cast_sizet(dyd->skim.n));
+  f->sizelineinfo = dyd->skim.n;
+  f->flag = (f->flag & PF_ISVARARG) | PF_LAZYTEXT;
+  if (ls->optimize)
+    f->flag |= PF_OPTIMIZE;
+  if (ls->hoist)
+    f->flag |= PF_HOIST;
+  luaM_shrinkvector(L, f->k, f->sizek, fs->nk, TValue);
+  luaM_shrinkvector(L, f->upvalues, f->sizeupvalues, fs->nups, Upvaldesc);
+  ls->fs = fs->prev;
+  luaC_checkGC(L);
+}
+
+/* }====================================================================== */
+
+
 static void body (LexState *ls, expdesc *e, int ismethod, int line) {
   /* body ->  '(' parlist ')' block END */
   FuncState new_fs;
   BlockCnt bl;
+  int skim;
   new_fs.f = addprototype(ls);
   new_fs.f->linedefined = line;
   open_func(ls, &new_fs, &bl);
@@ -1027,12 +1251,20 @@ static void body (LexState *ls, expdesc *e, int ismethod, int line) {
     adjustlocalvars(ls, 1);
   }
   parlist(ls);
-  checknext(ls, ')');
-  statlist(ls);
+  skim = (ls->lazy && ls->t.token == ')');
+  if (skim)
+    skimbody(ls, line);
+  else {
+    checknext(ls, ')');
+    statlist(ls);
+  }
   new_fs.f->lastlinedefined = ls->linenumber;
   check_match(ls, TK_END, TK_FUNCTION, line);
   codeclosure(ls, e);
-  close_func(ls);
+  if (skim)
+    close_lazy(ls);
+  else
+    close_func(ls);
 }
 
 
@@ -1049,19 +1281,43 @@ static int explist (LexState *ls, expdesc *v) {
 }
 
 
-static void funcargs (LexState *ls, expdesc *f) {
+/*
+** In mode "I", return the index of the local variable called by 'f'
+** if the call can be expanded inline (see 'luaK_inline'), or -1.
+*/
+static int inlinecall (FuncState *fs, expdesc *f) {
+  if (f->k == VLOCAL) {
+    Vardesc *var = getlocalvardesc(fs, f->u.var.vidx);
+    if (var->vd.pfunc >= 0 &&
+        luaK_caninline(fs, fs->f->p[var->vd.pfunc], fs->freereg))
+      return f->u.var.vidx;
+  }
+  return -1;
+}
+
+
+/*
+** Compile the arguments of a call to 'f' and the call itself. With
+** 'fvar' not -1, the call to that variable is expanded inline: 'f'
+** only has a register reserved for its result, and its arguments are
+** adjusted to the function parameters.
+*/
+static void funcargs (LexState *ls, expdesc *f, int fvar) {
   FuncState *fs = ls->fs;
   expdesc args;
   int base, nparams;
+  int nargs = 1;
   int line = ls->linenumber;
   switch (ls->t.token) {
     case '(': {  /* funcargs -> '(' [ explist ] ')' */
       luaX_next(ls);
-      if (ls->t.token == ')')  /* arg list is empty? */
+      if (ls->t.token == ')') {  /* arg list is empty? */
         args.k = VVOID;
+        nargs = 0;
+      }
       else {
-        explist(ls, &args);
-        if (hasmultret(args.k))
+        nargs = explist(ls, &args);
+        if (hasmultret(args.k) && fvar < 0)
           luaK_setmultret(fs, &args);
       }
       check_match(ls, ')', '(', line);
@@ -1082,6 +1338,18 @@ static void funcargs (LexState *ls, expdesc *f) {
   }
   lua_assert(f->k == VNONRELOC);
   base = f->u.info;  /* base register for call */
+  if (fvar >= 0) {  /* expand call inline? */
+    Vardesc *var = getlocalvardesc(fs, fvar);
+    Proto *p = fs->f->p[var->vd.pfunc];
+    int guard = (var->vd.kind == VDKREG)  /* may be assigned? */
+              ? getlocalvardesc(fs, fvar + 1)->vd.ridx
+              : NO_REG;
+    adjust_assign(ls, p->numparams, nargs, &args);
+    luaK_inline(fs, p, base, var->vd.ridx, guard, line);
+    init_exp(f, VINLINE, base);
+    fs->freereg = cast_byte(base + 1);
+    return;
+  }
   if (hasmultret(args.k))
     nparams = LUA_MULTRET;  /* open call */
   else {
@@ -1151,12 +1419,18 @@ static void suffixedexp (LexState *ls, expdesc *v) {
         luaX_next(ls);
         codename(ls, &key);
         luaK_self(fs, v, &key);
-        funcargs(ls, v);
+        funcargs(ls, v, -1);
         break;
       }
       case '(': case TK_STRING: case '{': {  /* funcargs */
-        luaK_exp2nextreg(fs, v);
-        funcargs(ls, v);
+        int fvar = inlinecall(fs, v);
+        if (fvar >= 0) {  /* function will not be needed in a register */
+          init_exp(v, VNONRELOC, fs->freereg);
+          luaK_reserveregs(fs, 1);
+        }
+        else
+          luaK_exp2nextreg(fs, v);
+        funcargs(ls, v, fvar);
         break;
       }
       default: return;
@@ -1569,16 +1843,20 @@ static void fixforjump (FuncState *fs, int pc, int dest, int back) {
 /*
 ** Generate code for a 'for' loop.
 */
-static void forbody (LexState *ls, int base, int line, int nvars, int isgen) {
+static void forbody (LexState *ls, int base, int line, int nvars, int isgen,
+                     int hoist) {
   /* forbody -> DO block */
   static const OpCode forprep[2] = {OP_FORPREP, OP_TFORPREP};
   static const OpCode forloop[2] = {OP_FORLOOP, OP_TFORLOOP};
   BlockCnt bl;
   FuncState *fs = ls->fs;
   int prep, endfor;
+  int prevcheck = fs->hoistcheck;
   checknext(ls, TK_DO);
   prep = luaK_codeABx(fs, forprep[isgen], base, 0);
   fs->freereg--;  /* both 'forprep' remove one register from the stack */
+  if (hoist != NO_REG)  /* loop hoists its loads? */
+    fs->hoistcheck = luaK_hoistcheck(fs, hoist);
   enterblock(fs, &bl, 0);  /* scope for declared variables */
   adjustlocalvars(ls, nvars);
   luaK_reserveregs(fs, nvars);
@@ -1592,13 +1870,29 @@ static void forbody (LexState *ls, int base, int line, int nvars, int isgen) {
   endfor = luaK_codeABx(fs, forloop[isgen], base, 0);
   fixforjump(fs, endfor, prep + 1, 1);
   luaK_fixline(fs, line);
+  if (hoist != NO_REG) {
+    luaK_hoist(fs, fs->hoistcheck, hoist, line);
+    fs->hoistcheck = prevcheck;
+  }
 }
 
 
 static void fornum (LexState *ls, TString *varname, int line) {
   /* fornum -> NAME = exp,exp[,exp] forbody */
   FuncState *fs = ls->fs;
-  int base = fs->freereg;
+  int hoist = NO_REG;
+  int base;
+  if (ls->hoist && fs->freereg + MAXHOIST + 1 <= MAXVARS / 2) {
+    /* hidden variables for the guard and the hoisted loads */
+    int i;
+    hoist = fs->freereg;
+    for (i = 0; i <= MAXHOIST; i++)
+      new_localvarliteral(ls, "(for hoist)");
+    luaK_nil(fs, hoist, MAXHOIST + 1);
+    luaK_reserveregs(fs, MAXHOIST + 1);
+    adjustlocalvars(ls, MAXHOIST + 1);
+  }
+  base = fs->freereg;
   new_localvarliteral(ls, "(for state)");
   new_localvarliteral(ls, "(for state)");
   new_localvarkind(ls, varname, RDKCONST);  /* control variable */
@@ -1613,7 +1907,7 @@ static void fornum (LexState *ls, TString *varname, int line) {
     luaK_reserveregs(fs, 1);
   }
   adjustlocalvars(ls, 2);  /* start scope for internal variables */
-  forbody(ls, base, line, 1, 0);
+  forbody(ls, base, line, 1, 0, hoist);
 }
 
 
@@ -1640,7 +1934,7 @@ static void forlist (LexState *ls, TString *indexname) {
   adjustlocalvars(ls, 3);  /* start scope for internal variables */
   marktobeclosed(fs);  /* last internal var. must be closed */
   luaK_checkstack(fs, 2);  /* extra space to call iterator */
-  forbody(ls, base, line, nvars - 3, 1);
+  forbody(ls, base, line, nvars - 3, 1, NO_REG);
 }
 
 
@@ -1713,6 +2007,41 @@ static void ifstat (LexState *ls, int line) {
 }
 
 
+/*
+** In mode "I", let calls to the last variable 'vidx', which got the
+** value of expression 'e', be expanded inline when that value is a
+** function just created. Unless the variable is <const>, a hidden copy
+** of the closure lets the expanded calls check that the variable still
+** has it.
+*/
+static void inlinefunc (LexState *ls, int vidx, expdesc *e) {
+  FuncState *fs = ls->fs;
+  Vardesc *var = getlocalvardesc(fs, vidx);
+  Instruction last;
+  int pf;
+  if (!ls->inlining || e->k != VNONRELOC || e->t != e->f || fs->pc == 0)
+    return;
+  last = fs->f->code[fs->pc - 1];
+  if (GET_OPCODE(last) != OP_CLOSURE || GETARG_A(last) != var->vd.ridx)
+    return;  /* not a function just created for the variable */
+  pf = GETARG_Bx(last);
+  if ((var->vd.kind != VDKREG && var->vd.kind != RDKCONST) ||
+      !luaK_inlinable(fs, fs->f->p[pf], var->vd.ridx))
+    return;
+  if (var->vd.kind == VDKREG) {  /* needs a guard? */
+    int reg = var->vd.ridx;
+    lua_assert(fs->freereg == reg + 1);
+    if (fs->nactvar >= MAXVARS / 2 || reg + 1 >= MAXVARS / 2)
+      return;  /* not worth the risk of exhausting variables */
+    new_localvarliteral(ls, "(inline)");
+    luaK_codeABC(fs, OP_MOVE, reg + 1, reg, 0);
+    luaK_reserveregs(fs, 1);
+    adjustlocalvars(ls, 1);
+  }
+  getlocalvardesc(fs, vidx)->vd.pfunc = cast(short, pf);
+}
+
+
 static void localfunc (LexState *ls) {
   expdesc b;
   FuncState *fs = ls->fs;
@@ -1722,6 +2051,7 @@ static void localfunc (LexState *ls) {
   body(ls, &b, 0, ls->linenumber);  /* function created in next register */
   /* debug information will only see the variable after this point! */
   localdebuginfo(fs, fvar)->startpc = fs->pc;
+  inlinefunc(ls, fvar, &b);
 }
 
 
@@ -1786,8 +2116,11 @@ static void localstat (LexState *ls) {
     fs->nactvar++;  /* but count it */
   }
   else {
+    expdesc f = e;  /* value of the last variable, if not adjusted */
     adjust_assign(ls, nvars, nexps, &e);
     adjustlocalvars(ls, nvars);
+    if (nvars == nexps)
+      inlinefunc(ls, fs->nactvar - 1, &f);
   }
   checktoclose(fs, toclose);
 }
@@ -1830,10 +2163,9 @@ static void exprstat (LexState *ls) {
     restassign(ls, &v, 1);
   }
   else {  /* stat -> func */
-    Instruction *inst;
-    check_condition(ls, v.v.k == VCALL, "syntax error");
-    inst = &getinstruction(fs, &v.v);
-    SETARG_C(*inst, 1);  /* call statement uses no results */
+    check_condition(ls, v.v.k == VCALL || v.v.k == VINLINE, "syntax error");
+    if (v.v.k == VCALL)
+      luaK_setreturns(fs, &v.v, 0);  /* call statement uses no results */
   }
 }
 
@@ -1968,7 +2300,8 @@ static void mainfunc (LexState *ls, FuncState *fs) {
 
 
 LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
-                       Dyndata *dyd, const char *name, int firstchar) {
+                       Dyndata *dyd, const char *name, int firstchar,
+                       int lazy, int optimize, int hoist, int inlining) {
   LexState lexstate;
   FuncState funcstate;
   LClosure *cl = luaF_newLclosure(L, 1);  /* create main closure */
@@ -1985,6 +2318,10 @@ LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
   lexstate.dyd = dyd;
   dyd->actvar.n = dyd->gt.n = dyd->label.n = 0;
   luaX_setinput(L, &lexstate, z, funcstate.f->source, firstchar);
+  lexstate.lazy = cast_byte(lazy);
+  lexstate.optimize = cast_byte(optimize);
+  lexstate.hoist = cast_byte(hoist);
+  lexstate.inlining = cast_byte(inlining);
   mainfunc(&lexstate, &funcstate);
   lua_assert(!funcstate.prev && funcstate.nups == 1 && !lexstate.fs);
   /* all scopes should be correctly finished */
@@ -1993,3 +2330,118 @@ LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
   return cl;  /* closure is on the stack, too */
 }
 
+
+/*
+** Prototypes have no back barrier, so after a prototype gets new
+** contents each of its references needs a forward barrier.
+*/
+static void barrierproto (lua_State *L, Proto *p) {
+  int i;
+  for (i = 0; i < p->sizek; i++)
+    luaC_barrier(L, p, &p->k[i]);
+  for (i = 0; i < p->sizeupvalues; i++)
+    if (p->upvalues[i].name)
+      luaC_objbarrier(L, p, p->upvalues[i].name);
+  for (i = 0; i < p->sizep; i++)
+    luaC_objbarrier(L, p, p->p[i]);
+  for (i = 0; i < p->sizelocvars; i++)
+    if (p->locvars[i].varname)
+      luaC_objbarrier(L, p, p->locvars[i].varname);
+}
+
+
+/*
+** Exchange the contents of prototypes 'p1' and 'p2'.
+*/
+static void swapproto (lua_State *L, Proto *p1, Proto *p2) {
+  Proto aux = *p1;
+  p1->numparams = p2->numparams; p1->flag = p2->flag;
+  p1->maxstacksize = p2->maxstacksize;
+  p1->sizeupvalues = p2->sizeupvalues; p1->sizek = p2->sizek;
+  p1->sizecode = p2->sizecode; p1->sizelineinfo = p2->sizelineinfo;
+  p1->sizep = p2->sizep; p1->sizelocvars = p2->sizelocvars;
+  p1->sizeabslineinfo = p2->sizeabslineinfo;
+  p1->linedefined = p2->linedefined;
+  p1->lastlinedefined = p2->lastlinedefined;
+  p1->k = p2->k; p1->code = p2->code; p1->p = p2->p;
+  p1->upvalues = p2->upvalues; p1->lineinfo = p2->lineinfo;
+  p1->abslineinfo = p2->abslineinfo; p1->locvars = p2->locvars;
+  p2->numparams = aux.numparams; p2->flag = aux.flag;
+  p2->maxstacksize = aux.maxstacksize;
+  p2->sizeupvalues = aux.sizeupvalues; p2->sizek = aux.sizek;
+  p2->sizecode = aux.sizecode; p2->sizelineinfo = aux.sizelineinfo;
+  p2->sizep = aux.sizep; p2->sizelocvars = aux.sizelocvars;
+  p2->sizeabslineinfo = aux.sizeabslineinfo;
+  p2->linedefined = aux.linedefined;
+  p2->lastlinedefined = aux.lastlinedefined;
+  p2->k = aux.k; p2->code = aux.code; p2->p = aux.p;
+  p2->upvalues = aux.upvalues; p2->lineinfo = aux.lineinfo;
+  p2->abslineinfo = aux.abslineinfo; p2->locvars = aux.locvars;
+  barrierproto(L, p1);
+  barrierproto(L, p2);
+}
+
+
+/*
+** Compile the text of the lazy prototype 'lp' (see 'skimbody'), read
+** from 'z', into a new prototype whose contents then go into 'lp'. The
+** function gets back the upvalues found when it was skimmed; its
+** compile-time constants are declared in a dummy enclosing function,
+** which uses 'lp' itself as its prototype.
+*/
+void luaY_parselazy (lua_State *L, Proto *lp, ZIO *z, Mbuffer *buff,
+                     Dyndata *dyd) {
+  LexState lexstate;
+  FuncState outer, funcstate;
+  BlockCnt bl, bl2;
+  Proto *f;
+  int i;
+  LClosure *cl = luaF_newLclosure(L, 0);  /* to anchor the new prototype */
+  setclLvalue2s(L, L->top.p, cl);
+  luaD_inctop(L);
+  lexstate.h = luaH_new(L);  /* create table for scanner */
+  sethvalue2s(L, L->top.p, lexstate.h);  /* anchor it */
+  luaD_inctop(L);
+  f = cl->p = luaF_newproto(L);
+  luaC_objbarrier(L, cl, f);
+  f->linedefined = lp->linedefined;
+  lexstate.buff = buff;
+  lexstate.dyd = dyd;
+  dyd->actvar.n = dyd->gt.n = dyd->label.n = 0;
+  luaX_setinput(L, &lexstate, z, lp->source, zgetc(z));
+  lexstate.lazy = 1;
+  lexstate.optimize = cast_byte((lp->flag & PF_OPTIMIZE) != 0);
+  lexstate.hoist = cast_byte((lp->flag & PF_HOIST) != 0);
+  lexstate.inlining = 0;  /* its local functions are all lazy */
+  lexstate.linenumber = lexstate.lastline = lp->linedefined;
+  luaX_next(&lexstate);  /* read first token */
+  outer.f = lp;
+  open_func(&lexstate, &outer, &bl);
+  for (i = 0; i + 1 < lp->sizek; i += 2) {  /* declare constants */
+    int vidx = new_localvar(&lexstate, tsvalue(&lp->k[i]));
+    Vardesc *var = getlocalvardesc(&outer, vidx);
+    var->vd.kind = RDKCTC;
+    setobj(L, &var->k, &lp->k[i + 1]);
+    outer.nactvar++;
+  }
+  funcstate.f = f;
+  open_func(&lexstate, &funcstate, &bl2);
+  for (i = 0; i < lp->sizeupvalues; i++) {  /* restore upvalues */
+    Upvaldesc *up = allocupvalue(&funcstate);
+    *up = lp->upvalues[i];
+    luaC_objbarrier(L, f, up->name);
+  }
+  checknext(&lexstate, '(');
+  parlist(&lexstate);
+  checknext(&lexstate, ')');
+  statlist(&lexstate);
+  f->lastlinedefined = lexstate.linenumber;
+  check_match(&lexstate, TK_END, TK_FUNCTION, lp->linedefined);
+  check(&lexstate, TK_EOS);
+  lua_assert(funcstate.nups == lp->sizeupvalues);
+  close_func(&lexstate);
+  leaveblock(&outer);
+  lua_assert(dyd->actvar.n == 0 && dyd->gt.n == 0 && dyd->label.n == 0);
+  swapproto(L, lp, f);  /* 'f' keeps the old contents, to be collected */
+  L->top.p -= 2;  /* remove closure and scanner's table */
+}
@@ -57,7 +57,8 @@ typedef enum {
   VRELOC,  /* expression can put result in any register;
               info = instruction pc */
   VCALL,  /* expression is a function call; info = instruction pc */
-  VVARARG  /* vararg expression; info = instruction pc */
+  VVARARG,  /* vararg expression; info = instruction pc */
+  VINLINE  /* function call expanded inline; info = result register */
 } expkind;
 
 
@@ -99,6 +100,7 @@ typedef union Vardesc {
     lu_byte kind;
     lu_byte ridx;  /* register holding the variable */
     short pidx;  /* index of the variable in the Proto's 'locvars' array */
+    short pfunc;  /* prototype of a function its calls expand (or -1) */
     TString *name;  /* variable name */
   } vd;
   TValue k;  /* constant value (if any) */
@@ -133,6 +135,11 @@ typedef struct Dyndata {
   } actvar;
   Labellist gt;  /* list of pending gotos */
   Labellist label;   /* list of active labels */
+  struct {  /* source of the function being skimmed */
+    char *arr;
+    int n;
+    int size;
+  } skim;
 } Dyndata;
 
 
@@ -148,6 +155,7 @@ typedef struct FuncState {
   struct BlockCnt *bl;  /* chain of current blocks */
   int pc;  /* next position to code (equivalent to 'ncode') */
   int lasttarget;   /* 'label' of last 'jump label' */
+  int hoistcheck;  /* check of innermost loop hoisting loads (or NO_JUMP) */
   int previousline;  /* last line that was saved in 'lineinfo' */
   int nk;  /* number of elements in 'k' */
   int np;  /* number of elements in 'p' */
@@ -167,7 +175,11 @@ LUAI_FUNC lu_byte luaY_nvarstack (FuncState *fs);
 LUAI_FUNC void luaY_checklimit (FuncState *fs, int v, int l,
                                 const char *what);
 LUAI_FUNC LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
-                                 Dyndata *dyd, const char *name, int firstchar);
+                                 Dyndata *dyd, const char *name, int firstchar,
+                                 int lazy, int optimize, int hoist,
+                                 int inlining);
+LUAI_FUNC void luaY_parselazy (lua_State *L, Proto *lp, ZIO *z,
+                               Mbuffer *buff, Dyndata *dyd);
 
 
 #endif
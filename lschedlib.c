@@ -0,0 +1,555 @@
+/*
+** $Id: lschedlib.c $
+** Scheduler Library
+** See Copyright Notice in lua.h
+*/
+
+#define lschedlib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+#include "llimits.h"
+
+
+/*
+** A scheduler runs tasks, each one a coroutine, until all of them
+** finish. A task runs until it sleeps, waits for a file descriptor,
+** yields, or finishes. Each iteration of the loop collects, as one
+** batch, all tasks whose timers expired and all tasks whose file
+** descriptors are ready, and then resumes all of them.
+**
+** Every wake-up source (a timer, a file descriptor) carries the
+** generation of its task at the time it was set; waking a task
+** changes its generation, so that other sources set for the same
+** wait become stale and are ignored.
+*/
+
+
+/*
+** {==================================================================
+** Configuration for the system-dependent parts
+** ===================================================================
+*/
+
+/* maximum number of file-descriptor events handled per iteration */
+#if !defined(LUA_SCHEDMAXEVENTS)
+#define LUA_SCHEDMAXEVENTS	64
+#endif
+
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <unistd.h>
+
+static lua_Number l_now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (lua_Number)ts.tv_sec + (lua_Number)ts.tv_nsec / 1e9;
+}
+
+static void l_sleep (lua_Number secs) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)secs;
+  ts.tv_nsec = (long)((secs - (lua_Number)ts.tv_sec) * 1e9);
+  nanosleep(&ts, NULL);
+}
+
+#else				/* }{ */
+
+static lua_Number l_now (void) {
+  return (lua_Number)clock() / (lua_Number)CLOCKS_PER_SEC;
+}
+
+static void l_sleep (lua_Number secs) {
+  lua_Number limit = l_now() + secs;
+  while (l_now() < limit) { /* busy wait */ }
+}
+
+#endif				/* } */
+
+
+#if defined(LUA_USE_LINUX)	/* { */
+
+#include <sys/epoll.h>
+
+#define l_haspoll	1
+
+#else				/* }{ */
+
+#define l_haspoll	0
+
+#endif				/* } */
+
+/* }================================================================== */
+
+
+/* task states */
+constexpr inline int TS_FREE = 0;  /* slot not in use */
+constexpr inline int TS_READY = 1;  /* in the run queue */
+constexpr inline int TS_RUNNING = 2;
+constexpr inline int TS_SLEEP = 3;  /* waiting for a timer */
+constexpr inline int TS_WAIT = 4;  /* waiting for a file descriptor */
+
+
+typedef struct Task {
+  lua_State *co;  /* its coroutine (anchored in the table of tasks) */
+  unsigned int gen;  /* generation, to recognize stale wake-ups */
+  int fd;  /* file descriptor it is waiting for (state TS_WAIT) */
+  int wake;  /* value to resume it with (-1: none, 0: false, 1: true) */
+  int next;  /* next free slot (state TS_FREE) */
+  lu_byte state;
+} Task;
+
+
+typedef struct Timer {
+  lua_Number when;
+  unsigned int seq;  /* order of creation, to break ties */
+  unsigned int gen;  /* generation of its task when created */
+  int task;
+} Timer;
+
+
+typedef struct Sched {
+  Task *tasks;
+  int sizetasks;
+  int freetask;  /* first free slot (-1 if none) */
+  int ntasks;  /* number of live tasks */
+  int *ready;  /* run queue */
+  int nready;
+  int sizeready;
+  Timer *heap;  /* timers (a binary min-heap) */
+  int nheap;
+  int sizeheap;
+  unsigned int seq;  /* number of timers created */
+  int nwaiting;  /* number of tasks waiting for file descriptors */
+  int epfd;  /* epoll instance (-1 if not created yet) */
+  int current;  /* task running now (-1 if none) */
+  int running;  /* true while 'run' is active */
+} Sched;
+
+
+#define SCHED	"sched.Scheduler"
+
+#define getsched(L)	((Sched *)lua_touserdata(L, lua_upvalueindex(1)))
+
+
+/*
+** Grow array 'block' of '*size' elements of size 'esize'
+*/
+static void *growarray (lua_State *L, void *block, int *size, size_t esize) {
+  void *ud;
+  lua_Alloc allocf = lua_getallocf(L, &ud);
+  int newsize = (*size > 0) ? *size * 2 : 16;
+  void *nb;
+  if (newsize > INT_MAX / 2)
+    luaL_error(L, "too many tasks");
+  nb = allocf(ud, block, (size_t)*size * esize, (size_t)newsize * esize);
+  if (nb == NULL)
+    luaL_error(L, "not enough memory");
+  *size = newsize;
+  return nb;
+}
+
+
+static void freearray (lua_State *L, void *block, int size, size_t esize) {
+  void *ud;
+  lua_Alloc allocf = lua_getallocf(L, &ud);
+  if (block != NULL)
+    allocf(ud, block, (size_t)size * esize, 0);
+}
+
+
+/*
+** {======================================================
+** Timers
+** =======================================================
+*/
+
+static int timerless (const Timer *a, const Timer *b) {
+  return (a->when < b->when || (a->when == b->when && a->seq < b->seq));
+}
+
+
+static void addtimer (lua_State *L, Sched *s, int task, lua_Number when) {
+  Timer t;
+  int i;
+  if (s->nheap == s->sizeheap)
+    s->heap = (Timer *)growarray(L, s->heap, &s->sizeheap, sizeof(Timer));
+  t.when = when;
+  t.seq = s->seq++;
+  t.gen = s->tasks[task].gen;
+  t.task = task;
+  i = s->nheap++;
+  while (i > 0 && timerless(&t, &s->heap[(i - 1) / 2])) {  /* sift up */
+    s->heap[i] = s->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  s->heap[i] = t;
+}
+
+
+static void poptimer (Sched *s) {
+  Timer last = s->heap[--s->nheap];
+  int i = 0;
+  for (;;) {  /* sift 'last' down from the root */
+    int c = 2 * i + 1;
+    if (c >= s->nheap)
+      break;
+    if (c + 1 < s->nheap && timerless(&s->heap[c + 1], &s->heap[c]))
+      c++;
+    if (!timerless(&s->heap[c], &last))
+      break;
+    s->heap[i] = s->heap[c];
+    i = c;
+  }
+  s->heap[i] = last;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Tasks
+** =======================================================
+*/
+
+static void pushready (lua_State *L, Sched *s, int task) {
+  if (s->nready == s->sizeready)
+    s->ready = (int *)growarray(L, s->ready, &s->sizeready, sizeof(int));
+  s->ready[s->nready++] = task;
+  s->tasks[task].state = TS_READY;
+}
+
+
+/*
+** Wake a sleeping or waiting task, to be resumed with 'wake'. (The
+** run queue has space for all live tasks, so this cannot fail.)
+*/
+static void waketask (Sched *s, int task, int wake) {
+  Task *t = &s->tasks[task];
+#if l_haspoll
+  if (t->state == TS_WAIT) {
+    epoll_ctl(s->epfd, EPOLL_CTL_DEL, t->fd, NULL);
+    s->nwaiting--;
+  }
+#endif
+  t->gen++;  /* other wake-ups for this wait are now stale */
+  t->wake = wake;
+  lua_assert(s->nready < s->sizeready);
+  s->ready[s->nready++] = task;
+  t->state = TS_READY;
+}
+
+
+/*
+** Create a new task with the function and arguments on the top of
+** the stack (the table of tasks is below them, at index 'tasks').
+*/
+static int newtask (lua_State *L, Sched *s, int tasks, int narg) {
+  lua_State *co;
+  int i;
+  if (s->freetask < 0) {  /* no free slots? */
+    int old = s->sizetasks;
+    s->tasks = (Task *)growarray(L, s->tasks, &s->sizetasks, sizeof(Task));
+    for (i = s->sizetasks - 1; i >= old; i--) {  /* link new free slots */
+      s->tasks[i].state = TS_FREE;
+      s->tasks[i].gen = 0;
+      s->tasks[i].next = s->freetask;
+      s->freetask = i;
+    }
+  }
+  while (s->sizeready < s->sizetasks)  /* keep space to wake all tasks */
+    s->ready = (int *)growarray(L, s->ready, &s->sizeready, sizeof(int));
+  co = lua_newthread(L);
+  lua_rotate(L, -(narg + 2), 1);  /* move thread below function */
+  lua_xmove(L, co, narg + 1);  /* move function and arguments to it */
+  i = s->freetask;
+  lua_rawseti(L, tasks, i + 1);  /* anchor thread */
+  s->freetask = s->tasks[i].next;
+  s->tasks[i].co = co;
+  s->tasks[i].wake = -1;
+  s->ntasks++;
+  pushready(L, s, i);
+  return i;
+}
+
+
+static void freetask (lua_State *L, Sched *s, int task) {
+  Task *t = &s->tasks[task];
+  lua_getiuservalue(L, lua_upvalueindex(1), 1);
+  lua_pushnil(L);
+  lua_rawseti(L, -2, task + 1);  /* release thread */
+  lua_pop(L, 1);
+  t->co = NULL;
+  t->gen++;
+  t->state = TS_FREE;
+  t->next = s->freetask;
+  s->freetask = task;
+  s->ntasks--;
+}
+
+
+/*
+** Get the task running in 'L', which is about to suspend itself.
+*/
+static Task *suspending (lua_State *L, Sched *s) {
+  if (s->current < 0 || s->tasks[s->current].co != L)
+    luaL_error(L, "not called from a scheduler task");
+  return &s->tasks[s->current];
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** The loop
+** =======================================================
+*/
+
+/*
+** Move to the run queue all tasks whose timers expired
+*/
+static void checktimers (Sched *s, lua_Number now) {
+  while (s->nheap > 0 && s->heap[0].when <= now) {
+    Timer t = s->heap[0];
+    Task *task = &s->tasks[t.task];
+    poptimer(s);
+    if (t.gen == task->gen)  /* not stale? */
+      waketask(s, t.task, (task->state == TS_WAIT) ? 0 : -1);
+  }
+}
+
+
+/*
+** Wait until some task can run, for at most 'timeout' seconds
+** (negative for no limit), moving to the run queue the tasks whose
+** file descriptors became ready.
+*/
+static void checkevents (Sched *s, lua_Number timeout) {
+#if l_haspoll
+  if (s->nwaiting > 0) {
+    struct epoll_event ev[LUA_SCHEDMAXEVENTS];
+    int ms = (timeout < 0) ? -1 : (int)(timeout * 1000 + 0.999);
+    int i, n = epoll_wait(s->epfd, ev, LUA_SCHEDMAXEVENTS, ms);
+    for (i = 0; i < n; i++) {
+      int task = (int)(ev[i].data.u64 & 0xffffffffu);
+      unsigned int gen = (unsigned int)(ev[i].data.u64 >> 32);
+      if (s->tasks[task].gen == gen && s->tasks[task].state == TS_WAIT)
+        waketask(s, task, 1);
+    }
+    return;
+  }
+#endif
+  if (timeout > 0)
+    l_sleep(timeout);
+}
+
+
+/*
+** Resume a task. Returns the status of the resume; in case of
+** errors, the message is on the top of 'L'.
+*/
+static int resumetask (lua_State *L, Sched *s, int task) {
+  lua_State *co = s->tasks[task].co;
+  int nargs, nres, status;
+  if (lua_status(co) == LUA_OK)  /* first run? */
+    nargs = lua_gettop(co) - 1;  /* arguments given to 'spawn' */
+  else if (s->tasks[task].wake < 0)
+    nargs = 0;
+  else {
+    lua_pushboolean(co, s->tasks[task].wake);
+    nargs = 1;
+  }
+  s->tasks[task].state = TS_RUNNING;
+  s->current = task;
+  status = lua_resume(co, L, nargs, &nres);
+  s->current = -1;
+  if (status == LUA_YIELD) {
+    lua_pop(co, nres);  /* yielded values are ignored */
+    if (s->tasks[task].state == TS_RUNNING) {  /* plain yield? */
+      s->tasks[task].wake = -1;
+      pushready(L, s, task);  /* run it again in the next batch */
+    }
+  }
+  else {  /* task finished */
+    int st = lua_closethread(co, L);  /* release its resources */
+    if (status != LUA_OK) {  /* error in the task? */
+      status = st;
+      lua_xmove(co, L, 1);  /* move error message */
+    }
+    freetask(L, s, task);
+  }
+  return status;
+}
+
+
+static int sched_run (lua_State *L) {
+  Sched *s = getsched(L);
+  if (s->running)
+    return luaL_error(L, "scheduler is already running");
+  s->running = 1;
+  while (s->ntasks > 0) {
+    int i, n;
+    checktimers(s, l_now());
+    if (s->nready > 0)
+      checkevents(s, 0);  /* only collect ready file descriptors */
+    else {  /* nothing to run; wait for the next wake-up */
+      lua_Number timeout = -1;
+      if (s->nheap > 0) {
+        timeout = s->heap[0].when - l_now();
+        if (timeout < 0) timeout = 0;
+      }
+      checkevents(s, timeout);
+      checktimers(s, l_now());
+    }
+    n = s->nready;  /* run this batch; tasks woken later go to the next */
+    for (i = 0; i < n; i++) {
+      int status = resumetask(L, s, s->ready[i]);
+      if (l_unlikely(status != LUA_OK && status != LUA_YIELD)) {
+        memmove(s->ready, s->ready + i + 1, (s->nready - i - 1) * sizeof(int));
+        s->nready -= i + 1;
+        s->running = 0;
+        return lua_error(L);  /* propagate error */
+      }
+    }
+    memmove(s->ready, s->ready + n, (s->nready - n) * sizeof(int));
+    s->nready -= n;
+  }
+  s->running = 0;
+  return 0;
+}
+
+/* }====================================================== */
+
+
+static int sched_spawn (lua_State *L) {
+  Sched *s = getsched(L);
+  int narg = lua_gettop(L) - 1;
+  int task;
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  lua_getiuservalue(L, lua_upvalueindex(1), 1);  /* table of tasks */
+  lua_insert(L, 1);
+  task = newtask(L, s, 1, narg);
+  lua_rawgeti(L, 1, task + 1);  /* return its coroutine */
+  return 1;
+}
+
+
+static int sched_sleep (lua_State *L) {
+  Sched *s = getsched(L);
+  lua_Number secs = luaL_checknumber(L, 1);
+  Task *t = suspending(L, s);
+  addtimer(L, s, s->current, l_now() + (secs > 0 ? secs : 0));
+  t->state = TS_SLEEP;
+  return lua_yield(L, 0);
+}
+
+
+static int sched_yield (lua_State *L) {
+  Sched *s = getsched(L);
+  suspending(L, s);
+  return lua_yield(L, 0);  /* 'resumetask' puts it back in the queue */
+}
+
+
+static int sched_wait (lua_State *L) {
+#if l_haspoll
+  static const char *const modes[] = {"r", "w", "rw", NULL};
+  static const unsigned int evs[] = {EPOLLIN, EPOLLOUT, EPOLLIN | EPOLLOUT};
+  Sched *s = getsched(L);
+  int fd = (int)luaL_checkinteger(L, 1);
+  unsigned int events = evs[luaL_checkoption(L, 2, "r", modes)];
+  lua_Number timeout = luaL_optnumber(L, 3, -1);
+  struct epoll_event ev;
+  Task *t = suspending(L, s);
+  if (s->epfd < 0 && (s->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    return luaL_error(L, "cannot create event queue (%s)", strerror(errno));
+  ev.events = events;
+  ev.data.u64 = (unsigned int)s->current | ((lua_Unsigned)t->gen << 32);
+  if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    return luaL_error(L, "cannot wait for descriptor %d (%s)",
+                         fd, strerror(errno));
+  if (timeout >= 0)
+    addtimer(L, s, s->current, l_now() + timeout);
+  t->fd = fd;
+  t->state = TS_WAIT;
+  s->nwaiting++;
+  return lua_yield(L, 0);
+#else
+  return luaL_error(L, "waiting for file descriptors not supported");
+#endif
+}
+
+
+static int sched_now (lua_State *L) {
+  lua_pushnumber(L, l_now());
+  return 1;
+}
+
+
+static int sched_count (lua_State *L) {
+  lua_pushinteger(L, getsched(L)->ntasks);
+  return 1;
+}
+
+
+static int sched_gc (lua_State *L) {
+  Sched *s = (Sched *)luaL_checkudata(L, 1, SCHED);
+  freearray(L, s->tasks, s->sizetasks, sizeof(Task));
+  freearray(L, s->ready, s->sizeready, sizeof(int));
+  freearray(L, s->heap, s->sizeheap, sizeof(Timer));
+  s->tasks = NULL; s->ready = NULL; s->heap = NULL;
+  s->sizetasks = s->sizeready = s->sizeheap = 0;
+#if l_haspoll
+  if (s->epfd >= 0) {
+    close(s->epfd);
+    s->epfd = -1;
+  }
+#endif
+  return 0;
+}
+
+
+static const luaL_Reg sched_funcs[] = {
+  {"spawn", sched_spawn},
+  {"run", sched_run},
+  {"sleep", sched_sleep},
+  {"wait", sched_wait},
+  {"yield", sched_yield},
+  {"now", sched_now},
+  {"count", sched_count},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_sched (lua_State *L) {
+  Sched *s;
+  luaL_newlibtable(L, sched_funcs);
+  s = (Sched *)lua_newuserdatauv(L, sizeof(Sched), 1);
+  memset(s, 0, sizeof(Sched));
+  s->freetask = -1;
+  s->epfd = -1;
+  s->current = -1;
+  if (luaL_newmetatable(L, SCHED)) {
+    lua_pushcfunction(L, sched_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  lua_newtable(L);  /* table of tasks */
+  lua_setiuservalue(L, -2, 1);
+  luaL_setfuncs(L, sched_funcs, 1);
+  return 1;
+}
+
@@ -162,15 +162,17 @@ LUAI_FUNC void luaE_incCstack (lua_State *L) {
 }
 
 
-static void stack_init (lua_State *L1, lua_State *L) {
+/*
+** (Re)initialize a stack of 'size' slots, already allocated, and
+** the first ci
+*/
+static void stack_reset (lua_State *L1, int size) {
   int i; CallInfo *ci;
-  /* initialize stack array */
-  L1->stack.p = luaM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, StackValue);
   L1->tbclist.p = L1->stack.p;
-  for (i = 0; i < BASIC_STACK_SIZE + EXTRA_STACK; i++)
+  for (i = 0; i < size + EXTRA_STACK; i++)
     setnilvalue(s2v(L1->stack.p + i));  /* erase new stack */
   L1->top.p = L1->stack.p;
-  L1->stack_last.p = L1->stack.p + BASIC_STACK_SIZE;
+  L1->stack_last.p = L1->stack.p + size;
   /* initialize first ci */
   ci = &L1->base_ci;
   ci->next = ci->previous = NULL;
@@ -184,14 +186,21 @@ static void stack_init (lua_State *L1, lua_State *L) {
 }
 
 
+static void stack_init (lua_State *L1, lua_State *L) {
+  /* initialize stack array */
+  L1->stack.p = luaM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, StackValue);
+  stack_reset(L1, BASIC_STACK_SIZE);
+}
+
+
 static void freestack (lua_State *L) {
   if (L->stack.p == NULL)
     return;  /* stack not completely built yet */
   L->ci = &L->base_ci;  /* free the entire 'ci' list */
   freeCI(L);
   lua_assert(L->nci == 0);
-  /* free stack */
-  luaM_freearray(L, L->stack.p, cast_sizet(stacksize(L) + EXTRA_STACK));
+  luaF_freeupvalidx(L);
+  luaD_freestack(L);  /* free stack */
 }
 
 
@@ -240,6 +249,7 @@ static void f_luaopen (lua_State *L, void *ud) {
 static void preinit_thread (lua_State *L, global_State *g) {
   G(L) = g;
   L->stack.p = NULL;
+  L->stackmapped = 0;
   L->ci = NULL;
   L->nci = 0;
   L->twups = L;  /* thread has no upvalues */
@@ -251,6 +261,7 @@ static void preinit_thread (lua_State *L, global_State *g) {
   L->allowhook = 1;
   resethookcount(L);
   L->openupval = NULL;
+  L->upvalidx = NULL;
   L->status = LUA_OK;
   L->errfunc = 0;
   L->oldpc = 0;
@@ -275,6 +286,8 @@ static void close_state (lua_State *L) {
     luaC_freeallobjects(L);  /* collect all objects */
     luai_userstateclose(L);
   }
+  G(L)->maxthreadpool = 0;
+  luaE_shrinkthreadpool(L);  /* free all pooled threads */
   luaM_freearray(L, G(L)->strt.hash, cast_sizet(G(L)->strt.size));
   freestack(L);
   lua_assert(gettotalbytes(g) == sizeof(LG));
@@ -286,10 +299,25 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   global_State *g = G(L);
   GCObject *o;
   lua_State *L1;
+  StkId stack = NULL;
+  int size = 0;
   lua_lock(L);
   luaC_checkGC(L);
-  /* create new thread */
-  o = luaC_newobjdt(L, LUA_TTHREAD, sizeof(LX), offsetof(LX, l));
+  if (g->threadpool != NULL) {  /* reuse a collected thread? */
+    o = g->threadpool;
+    g->threadpool = o->next;
+    g->nthreadpool--;
+    g->threadhits++;
+    o->marked = luaC_white(g);  /* link it back as a new object */
+    o->next = g->allgc;
+    g->allgc = o;
+    stack = gco2th(o)->stack.p;  /* keep its stack */
+    size = stacksize(gco2th(o));
+  }
+  else {  /* create new thread */
+    o = luaC_newobjdt(L, LUA_TTHREAD, sizeof(LX), offsetof(LX, l));
+    g->threadmisses++;
+  }
   L1 = gco2th(o);
   /* anchor it on L stack */
   setthvalue2s(L, L->top.p, L1);
@@ -303,24 +331,71 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   memcpy(lua_getextraspace(L1), lua_getextraspace(g->mainthread),
          LUA_EXTRASPACE);
   luai_userstatethread(L, L1);
-  stack_init(L1, L);  /* init stack */
+  if (stack != NULL) {  /* reused thread? */
+    L1->stack.p = stack;
+    stack_reset(L1, size);
+  }
+  else
+    stack_init(L1, L);  /* init stack */
   lua_unlock(L);
   return L1;
 }
 
 
+/*
+** Free a collected thread. While the pool is not full, a thread with
+** a small stack (not larger than a basic one, as the stacks of
+** finished coroutines) keeps the stack and goes to the pool, to be
+** reused by 'lua_newthread'; only its 'ci' list is released. (Threads
+** freed when closing the state are not pooled.)
+*/
 void luaE_freethread (lua_State *L, lua_State *L1) {
+  global_State *g = G(L);
   LX *l = fromstate(L1);
   luaF_closeupval(L1, L1->stack.p);  /* close all upvalues */
   lua_assert(L1->openupval == NULL);
+  luaF_freeupvalidx(L1);
   luai_userstatefree(L, L1);
+  if (g->nthreadpool < g->maxthreadpool && !(g->gcstp & GCSTPCLS) &&
+      L1->stack.p != NULL && !L1->stackmapped &&
+                             stacksize(L1) > LUA_MINSTACK &&
+                             stacksize(L1) <= BASIC_STACK_SIZE) {
+    L1->ci = &L1->base_ci;
+    freeCI(L1);  /* release the whole 'ci' list */
+    L1->next = g->threadpool;
+    g->threadpool = obj2gco(L1);
+    g->nthreadpool++;
+    return;
+  }
   freestack(L1);
   luaM_free(L, l);
 }
 
 
+/*
+** Free pooled threads until the pool fits in its maximum size
+*/
+void luaE_shrinkthreadpool (lua_State *L) {
+  global_State *g = G(L);
+  while (g->nthreadpool > g->maxthreadpool) {
+    lua_State *L1 = gco2th(g->threadpool);
+    g->threadpool = L1->next;
+    g->nthreadpool--;
+    freestack(L1);
+    luaM_free(L, fromstate(L1));
+  }
+}
+
+
+/*
+** Reset a thread to its initial state, closing its pending to-be-closed
+** variables. Everything the thread used for its calls (the 'ci' list
+** and the extra stack) is released at once, so that a finished thread
+** costs only its basic stack, both in memory and in collector work.
+*/
 int luaE_resetthread (lua_State *L, int status) {
   CallInfo *ci = L->ci = &L->base_ci;  /* unwind CallInfo list */
+  freeCI(L);  /* release all CallInfo structures */
   setnilvalue(s2v(L->stack.p));  /* 'function' entry for basic 'ci' */
   ci->func.p = L->stack.p;
   ci->callstatus = CIST_C;
@@ -369,6 +444,7 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, unsigned seed) {
   g->ud_warn = NULL;
   g->mainthread = L;
   g->seed = seed;
+  g->hoistepoch = 0;
   g->gcstp = GCSTPGC;  /* no GC while building state */
   g->strt.size = g->strt.nuse = 0;
   g->strt.hash = NULL;
@@ -378,16 +454,26 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, unsigned seed) {
   g->gckind = KGC_INC;
   g->gcstopem = 0;
   g->gcemergency = 0;
+  g->gcdeferfin = 0;
   g->finobj = g->tobefnz = g->fixedgc = NULL;
   g->firstold1 = g->survival = g->old1 = g->reallyold = NULL;
   g->finobjsur = g->finobjold1 = g->finobjrold = NULL;
   g->sweepgc = NULL;
   g->gray = g->grayagain = NULL;
   g->weak = g->ephemeron = g->allweak = NULL;
+  g->ephdeps = NULL;
   g->twups = NULL;
   g->GCtotalbytes = sizeof(LG);
   g->GCmarked = 0;
   g->GCdebt = 0;
+  g->GClimit = MAX_LMEM;  /* no memory limit */
+  g->fuel = MAX_LMEM;
+  g->fuelmode = 0;  /* no fuel limit */
+  g->GClimithits = 0;
+  g->threadhits = g->threadmisses = 0;
+  g->threadpool = NULL;
+  g->nthreadpool = 0;
+  g->maxthreadpool = LUAI_THREADPOOL;
   setivalue(&g->nilvalue, 0);  /* to signal that state is not yet built */
   setgcparam(g, PAUSE, LUAI_GCPAUSE);
   setgcparam(g, STEPMUL, LUAI_GCMUL);
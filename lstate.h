@@ -155,6 +155,12 @@ constexpr inline int EXTRA_STACK = 5;
 
 #define BASIC_STACK_SIZE        (2*LUA_MINSTACK)
 
+/*
+** Default maximum number of collected threads kept, with their basic
+** stacks, to be reused by 'lua_newthread'
+*/
+constexpr inline int LUAI_THREADPOOL = 32;
+
 #define stacksize(th)	cast_int((th)->stack_last.p - (th)->stack.p)
 
 
@@ -238,6 +244,8 @@ constexpr inline int CIST_RECST = 17;  /* the offset, not the mask */
 /* using __lt for __le */
 constexpr inline l_uint32 CIST_LEQ = (cast(l_uint32, 1) << 20);
 #endif
+/* call is a metamethod run by the caller's "luaV_execute" frame */
+constexpr inline l_uint32 CIST_TM = (cast(l_uint32, 1) << 21);
 
 
 #define get_nresults(cs)  (cast_int((cs) & CIST_NRESULTS) - 1)
@@ -278,10 +286,16 @@ typedef struct global_State {
   l_mem GCdebt;  /* bytes counted but not yet allocated */
   l_mem GCmarked;  /* number of objects marked in a GC cycle */
   l_mem GCmajorminor;  /* auxiliary counter to control major-minor shifts */
+  l_mem GClimit;  /* hard limit for allocated bytes (MAX_LMEM: no limit) */
+  l_mem fuel;  /* back edges and Lua calls left to execute */
+  lu_mem GClimithits;  /* number of allocations refused by 'GClimit' */
+  lu_mem threadhits;  /* number of threads reused from 'threadpool' */
+  lu_mem threadmisses;  /* number of threads created anew */
   stringtable strt;  /* hash table for strings */
   TValue l_registry;
   TValue nilvalue;  /* a nil value */
   unsigned int seed;  /* randomized seed for hashes */
+  lu_mem hoistepoch;  /* changes with stores into watched keys */
   lu_byte gcparams[LUA_GCPN];
   lu_byte currentwhite;
   lu_byte gcstate;  /* state of garbage collector */
@@ -289,6 +303,8 @@ typedef struct global_State {
   lu_byte gcstopem;  /* stops emergency collections */
   lu_byte gcstp;  /* control whether GC is running */
   lu_byte gcemergency;  /* true if this is an emergency collection */
+  lu_byte gcdeferfin;  /* true if finalizers wait for 'lua_runfinalizers' */
+  lu_byte fuelmode;  /* what to do when 'fuel' runs out (see 'ldebug.c') */
   GCObject *allgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* current position of sweep in list */
   GCObject *finobj;  /* list of collectable objects with finalizers */
@@ -297,6 +313,7 @@ typedef struct global_State {
   GCObject *weak;  /* list of tables with weak values */
   GCObject *ephemeron;  /* list of ephemeron tables (weak keys) */
   GCObject *allweak;  /* list of all-weak tables */
+  struct EphDeps *ephdeps;  /* pending ephemeron entries (during convergence) */
   GCObject *tobefnz;  /* list of userdata to be GC */
   GCObject *fixedgc;  /* list of objects not to be collected */
   /* fields for generational collector */
@@ -308,6 +325,9 @@ typedef struct global_State {
   GCObject *finobjold1;  /* list of old1 objects with finalizers */
   GCObject *finobjrold;  /* list of really old objects with finalizers */
   struct lua_State *twups;  /* list of threads with open upvalues */
+  GCObject *threadpool;  /* list of collected threads kept for reuse */
+  int nthreadpool;  /* number of threads in 'threadpool' */
+  int maxthreadpool;  /* maximum size of 'threadpool' */
   lua_CFunction panic;  /* to be called in unprotected errors */
   struct lua_State *mainthread;
   TString *memerrmsg;  /* message for memory-allocation errors */
@@ -326,6 +346,7 @@ struct lua_State {
   CommonHeader;
   lu_byte status;
   lu_byte allowhook;
+  lu_byte stackmapped;  /* stack is in reserved address space */
   unsigned short nci;  /* number of items in 'ci' list */
   StkIdRel top;  /* first free slot in the stack */
   global_State *l_G;
@@ -333,9 +354,13 @@ struct lua_State {
   StkIdRel stack_last;  /* end of stack (last element + 1) */
   StkIdRel stack;  /* stack base */
   UpVal *openupval;  /* list of open upvalues in this stack */
+  UpVal **upvalidx;  /* open upvalues by stack slot (see 'lfunc.c') */
   StkIdRel tbclist;  /* list of to-be-closed variables */
   GCObject *gclist;
   struct lua_State *twups;  /* list of threads with open upvalues */
+  GCObject *threadpool;  /* list of collected threads kept for reuse */
+  int nthreadpool;  /* number of threads in 'threadpool' */
+  int maxthreadpool;  /* maximum size of 'threadpool' */
   struct lua_longjmp *errorJmp;  /* current error recover point */
   CallInfo base_ci;  /* CallInfo for first level (C calling Lua) */
   volatile lua_Hook hook;
@@ -417,6 +442,7 @@ LUA_INL Closure*  gco2cl(const GCObject* o)  { return check_exp(novariant((o)->t
 
 LUAI_FUNC void luaE_setdebt (global_State *g, l_mem debt);
 LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
+LUAI_FUNC void luaE_shrinkthreadpool (lua_State *L);
 LUAI_FUNC size_t luaE_threadsize (lua_State *L);
 LUAI_FUNC CallInfo *luaE_extendCI (lua_State *L);
 LUAI_FUNC void luaE_shrinkCI (lua_State *L);
@@ -42,10 +42,21 @@
                                  (sizeof(s)/sizeof(char))-1))
 
 
+/*
+** For short strings, the low bits of 'extra' number reserved words and
+** its high bit marks keys of loads hoisted out of loops (see
+** 'luaK_hoist'), which must be watched by stores.
+*/
+#define WATCHEDKEY	0x80
+
+#define iswatched(s)	((s)->extra & WATCHEDKEY)
+
+
 /*
 ** test whether a string is a reserved word
 */
-#define isreserved(s)	((s)->tt == LUA_VSHRSTR && (s)->extra > 0)
+#define isreserved(s)	((s)->tt == LUA_VSHRSTR && \
+                         ((s)->extra & ~WATCHEDKEY) > 0)
 
 
 /*
@@ -223,6 +223,8 @@ static int writer (lua_State *L, const void *b, size_t size, void *ud) {
 static int str_dump (lua_State *L) {
   struct str_Writer state;
   int strip = lua_toboolean(L, 2);
+  if (lua_toboolean(L, 3))  /* lazy format? */
+    strip |= LUA_DUMPLAZY;
   luaL_argcheck(L, lua_type(L, 1) == LUA_TFUNCTION && !lua_iscfunction(L, 1),
                    1, "Lua function expected");
   /* ensure function is on the top of the stack and vacate slot 1 */
@@ -1835,19 +1837,16 @@ static int str_unpack (lua_State *L) {
 
 
 static const luaL_Reg strlib[] = {
-  {"byte", str_byte},
   {"char", str_char},
   {"dump", str_dump},
   {"find", str_find},
   {"format", str_format},
   {"gmatch", gmatch},
   {"gsub", str_gsub},
-  {"len", str_len},
   {"lower", str_lower},
   {"match", str_match},
   {"rep", str_rep},
   {"reverse", str_reverse},
-  {"sub", str_sub},
   {"upper", str_upper},
   {"pack", str_pack},
   {"packsize", str_packsize},
@@ -1856,6 +1855,18 @@ static const luaL_Reg strlib[] = {
 };
 
 
+/*
+** functions called directly by the interpreter (see 'lua_pushleaf'),
+** with their usual number of arguments in method calls
+*/
+static const luaL_Leaf strleaves[] = {
+  {"byte", str_byte, 2},
+  {"len", str_len, 1},
+  {"sub", str_sub, 3},
+  {NULL, NULL, 0}
+};
+
+
 static void createmetatable (lua_State *L) {
   /* table to be metatable for strings */
   luaL_newlibtable(L, stringmetamethods);
@@ -1875,6 +1886,7 @@ static void createmetatable (lua_State *L) {
 */
 LUAMOD_API int luaopen_string (lua_State *L) {
   luaL_newlib(L, strlib);
+  luaL_setleaves(L, strleaves);
   createmetatable(L);
   return 1;
 }
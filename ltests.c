@@ -393,6 +393,7 @@ static void checkproto (global_State *g, Proto *f) {
   int i;
   GCObject *fgc = obj2gco(f);
   checkobjrefN(g, fgc, f->source);
+  checkobjrefN(g, fgc, f->cache);
   for (i=0; i<f->sizek; i++) {
     if (iscollectable(f->k + i))
       checkobjref(g, fgc, gcvalue(f->k + i));
@@ -449,8 +450,11 @@ static void checkstack (global_State *g, lua_State *L1) {
     assert(L1->openupval == NULL && L1->ci == NULL);
     return;
   }
-  for (uv = L1->openupval; uv != NULL; uv = uv->u.open.next)
+  for (uv = L1->openupval; uv != NULL; uv = uv->u.open.next) {
     assert(upisopen(uv));  /* must be open */
+    assert(L1->upvalidx == NULL ||
+           L1->upvalidx[uplevel(uv) - L1->stack.p] == uv);
+  }
   assert(L1->top.p <= L1->stack_last.p);
   assert(L1->tbclist.p <= L1->top.p);
   for (ci = L1->ci; ci != NULL; ci = ci->previous) {
@@ -1268,6 +1272,133 @@ static int loadlib (lua_State *L) {
   return 0;
 }
 
+/*
+** T.loadchunks({chunk1, ...} [, mode]): load the chunks with
+** 'luaL_loadbuffers'; returns the number of errors and a list with,
+** for each chunk, its function (or message) and its status.
+*/
+static int loadchunks (lua_State *L) {
+  const char *mode = luaL_optstring(L, 2, NULL);
+  int n = cast_int(luaL_len(L, 1));
+  const char **buffs = cast(const char **, lua_newuserdatauv(L,
+                                 n * (2 * sizeof(char *) + sizeof(size_t)
+                                      + sizeof(int)) + 1, 0));
+  const char **names = buffs + n;
+  size_t *sizes = cast(size_t *, names + n);
+  int *status = cast(int *, sizes + n);
+  int i, nerrors;
+  for (i = 0; i < n; i++) {
+    lua_geti(L, 1, i + 1);
+    buffs[i] = luaL_checklstring(L, -1, &sizes[i]);
+    names[i] = "=chunk";
+    lua_pop(L, 1);  /* (string is kept by the table) */
+  }
+  nerrors = luaL_loadbuffers(L, n, buffs, sizes, names, mode, status);
+  lua_createtable(L, 2 * n, 0);
+  for (i = n; i >= 1; i--) {
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, 2 * i - 1);
+    lua_pushinteger(L, status[i - 1]);
+    lua_rawseti(L, -2, 2 * i);
+  }
+  lua_pushinteger(L, nerrors);
+  lua_insert(L, -2);
+  return 2;
+}
+
+
+/*
+** T.newshared(f): create a shared chunk with function 'f'.
+** T.loadshared(sc [, L1]): load shared chunk 'sc' into the running
+** state, returning the function (or nil plus the message), or into
+** state 'L1', setting the function as its global 'shared' and
+** returning the status.
+** T.releaseshared(sc): release the reference created by 'newshared'.
+*/
+static int newshared (lua_State *L) {
+  lua_pushlightuserdata(L, luaL_newshared(L, 1));
+  return 1;
+}
+
+
+static int loadshared (lua_State *L) {
+  luaL_SharedChunk *sc = cast(luaL_SharedChunk *, lua_touserdata(L, 1));
+  luaL_argcheck(L, sc != NULL, 1, "shared chunk expected");
+  if (lua_isnoneornil(L, 2)) {
+    if (luaL_loadshared(L, sc, "=shared") == LUA_OK)
+      return 1;
+    luaL_pushfail(L);
+    lua_insert(L, -2);
+    return 2;
+  }
+  else {
+    lua_State *L1 = cast(lua_State *, lua_touserdata(L, 2));
+    int status = luaL_loadshared(L1, sc, "=shared");
+    if (status == LUA_OK)
+      lua_setglobal(L1, "shared");
+    else
+      lua_pop(L1, 1);  /* remove error message */
+    lua_pushinteger(L, status);
+    return 1;
+  }
+}
+
+
+static int releaseshared (lua_State *L) {
+  luaL_SharedChunk *sc = cast(luaL_SharedChunk *, lua_touserdata(L, 1));
+  luaL_argcheck(L, sc != NULL, 1, "shared chunk expected");
+  luaL_releaseshared(sc);
+  return 0;
+}
+
+
+/*
+** T.pipe(): create a pipe, returning its read and write descriptors.
+** T.writefd(fd, s), T.readfd(fd, n), T.closefd(fd): basic operations
+** over descriptors (to test the scheduler library).
+*/
+#if defined(LUA_USE_POSIX)
+
+#include <unistd.h>
+
+static int l_pipe (lua_State *L) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    return luaL_error(L, "cannot create pipe");
+  lua_pushinteger(L, fds[0]);
+  lua_pushinteger(L, fds[1]);
+  return 2;
+}
+
+
+static int writefd (lua_State *L) {
+  size_t l;
+  const char *s = luaL_checklstring(L, 2, &l);
+  lua_pushinteger(L, write(cast_int(luaL_checkinteger(L, 1)), s, l));
+  return 1;
+}
+
+
+static int readfd (lua_State *L) {
+  char buff[256];
+  size_t n = cast_sizet(luaL_optinteger(L, 2, sizeof(buff)));
+  ssize_t r = read(cast_int(luaL_checkinteger(L, 1)), buff,
+                   (n < sizeof(buff)) ? n : sizeof(buff));
+  if (r < 0)
+    return 0;
+  lua_pushlstring(L, buff, cast_sizet(r));
+  return 1;
+}
+
+
+static int closefd (lua_State *L) {
+  close(cast_int(luaL_checkinteger(L, 1)));
+  return 0;
+}
+
+#endif
+
+
 static int closestate (lua_State *L) {
   lua_State *L1 = getstate(L);
   lua_close(L1);
@@ -2050,6 +2181,16 @@ static const struct luaL_Reg tests_funcs[] = {
   {"listabslineinfo", listabslineinfo},
   {"listlocals", listlocals},
   {"loadlib", loadlib},
+  {"loadchunks", loadchunks},
+  {"newshared", newshared},
+  {"loadshared", loadshared},
+  {"releaseshared", releaseshared},
+#if defined(LUA_USE_POSIX)
+  {"pipe", l_pipe},
+  {"writefd", writefd},
+  {"readfd", readfd},
+  {"closefd", closefd},
+#endif
   {"checkpanic", checkpanic},
   {"newstate", newstate},
   {"newuserdata", newuserdata},
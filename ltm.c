@@ -147,9 +147,16 @@ static int callbinTM (lua_State *L, const TValue *p1, const TValue *p2,
 }
 
 
-void luaT_trybinTM (lua_State *L, const TValue *p1, const TValue *p2,
-                    StkId res, TMS event) {
-  if (l_unlikely(callbinTM(L, p1, p2, res, event) < 0)) {
+/*
+** Get the metamethod for a binary (or unary) operation over 'p1' and
+** 'p2', raising an error if there is none.
+*/
+const TValue *luaT_binTM (lua_State *L, const TValue *p1, const TValue *p2,
+                          TMS event) {
+  const TValue *tm = luaT_gettmbyobj(L, p1, event);  /* try first operand */
+  if (notm(tm))
+    tm = luaT_gettmbyobj(L, p2, event);  /* try second operand */
+  if (l_unlikely(notm(tm))) {
     switch (event) {
       case TM_BAND: case TM_BOR: case TM_BXOR:
       case TM_SHL: case TM_SHR: case TM_BNOT: {
@@ -163,6 +170,13 @@ void luaT_trybinTM (lua_State *L, const TValue *p1, const TValue *p2,
         luaG_opinterror(L, p1, p2, "perform arithmetic on");
     }
   }
+  return tm;
+}
+
+
+void luaT_trybinTM (lua_State *L, const TValue *p1, const TValue *p2,
+                    StkId res, TMS event) {
+  luaT_callTMres(L, luaT_binTM(L, p1, p2, event), p1, p2, res);
 }
 
 
@@ -177,23 +191,6 @@ void luaT_tryconcatTM (lua_State *L) {
 }
 
 
-void luaT_trybinassocTM (lua_State *L, const TValue *p1, const TValue *p2,
-                                       int flip, StkId res, TMS event) {
-  if (flip)
-    luaT_trybinTM(L, p2, p1, res, event);
-  else
-    luaT_trybinTM(L, p1, p2, res, event);
-}
-
-
-void luaT_trybiniTM (lua_State *L, const TValue *p1, lua_Integer i2,
-                                   int flip, StkId res, TMS event) {
-  TValue aux;
-  setivalue(&aux, i2);
-  luaT_trybinassocTM(L, p1, &aux, flip, res, event);
-}
-
-
 /*
 ** Calls an order tag method.
 ** For lessequal, LUA_COMPAT_LT_LE keeps compatibility with old
@@ -246,6 +243,8 @@ void luaT_adjustvarargs (lua_State *L, int nfixparams, CallInfo *ci,
   int actual = cast_int(L->top.p - ci->func.p) - 1;  /* number of arguments */
   int nextra = actual - nfixparams;  /* number of extra arguments */
   ci->u.l.nextraargs = nextra;
+  if (nextra == 0)  /* no extra arguments? */
+    return;  /* frame is already in place (see 'luaT_vadelta') */
   luaD_checkstack(L, p->maxstacksize + 1);
   /* copy function to the top of the stack */
   setobjs2s(L, L->top.p++, ci->func.p);
@@ -268,9 +267,12 @@ void luaT_getvarargs (lua_State *L, CallInfo *ci, StkId where, int wanted) {
     checkstackp(L, nextra, where);  /* ensure stack space */
     L->top.p = where + nextra;  /* next instruction will need top */
   }
-  for (i = 0; i < wanted && i < nextra; i++)
+  else if (wanted > nextra) {  /* not enough extra arguments? */
+    for (i = nextra; i < wanted; i++)
+      setnilvalue(s2v(where + i));  /* complete required results with nil */
+    wanted = nextra;
+  }
+  for (i = 0; i < wanted; i++)
     setobjs2s(L, where + i, ci->func.p - nextra + i);
-  for (; i < wanted; i++)   /* complete required results with nil */
-    setnilvalue(s2v(where + i));
 }
 
@@ -67,6 +67,15 @@ constexpr inline lu_byte maskflags = cast_byte(~(~0u << (TM_EQ + 1)));
 
 #define fasttm(l,mt,e)	gfasttm(G(l), mt, e)
 
+/*
+** Distance between the virtual 'func' of a vararg function (where its
+** frame starts) and its real 'func' (the one in the caller's frame).
+** 'nparams1' is the number of fixed parameters plus 1. A call without
+** extra arguments keeps its frame in place, so the distance is zero.
+*/
+#define luaT_vadelta(ci,nparams1)  \
+	((ci)->u.l.nextraargs ? (ci)->u.l.nextraargs + (nparams1) : 0)
+
 #define ttypename(x)	luaT_typenames_[(x) + 1]
 
 LUAI_DDEC(const char *const luaT_typenames_[LUA_TOTALTYPES];)
@@ -83,13 +92,11 @@ LUAI_FUNC void luaT_callTM (lua_State *L, const TValue *f, const TValue *p1,
                             const TValue *p2, const TValue *p3);
 LUAI_FUNC lu_byte luaT_callTMres (lua_State *L, const TValue *f,
                                const TValue *p1, const TValue *p2, StkId p3);
+LUAI_FUNC const TValue *luaT_binTM (lua_State *L, const TValue *p1,
+                                    const TValue *p2, TMS event);
 LUAI_FUNC void luaT_trybinTM (lua_State *L, const TValue *p1, const TValue *p2,
                               StkId res, TMS event);
 LUAI_FUNC void luaT_tryconcatTM (lua_State *L);
-LUAI_FUNC void luaT_trybinassocTM (lua_State *L, const TValue *p1,
-       const TValue *p2, int inv, StkId res, TMS event);
-LUAI_FUNC void luaT_trybiniTM (lua_State *L, const TValue *p1, lua_Integer i2,
-                               int inv, StkId res, TMS event);
 LUAI_FUNC int luaT_callorderTM (lua_State *L, const TValue *p1,
                                 const TValue *p2, TMS event);
 LUAI_FUNC int luaT_callorderiTM (lua_State *L, const TValue *p1, int v2,
@@ -372,6 +372,17 @@ static int runargs (lua_State *L, char **argv, int n) {
 }
 
 
+/*
+** Variable LUA_CHUNKCACHE, when set, is the prefix for the files of
+** the compiled-chunk cache (see 'luaL_setchunkcache').
+*/
+static void handle_chunkcache (lua_State *L) {
+  const char *prefix = getenv("LUA_CHUNKCACHE");
+  if (prefix != NULL && *prefix != '\0')
+    luaL_setchunkcache(L, prefix);
+}
+
+
 static int handle_luainit (lua_State *L) {
   const char *name = "=" LUA_INITVARVERSION;
   const char *init = getenv(name + 1);
@@ -713,6 +724,7 @@ static int pmain (lua_State *L) {
   lua_gc(L, LUA_GCRESTART);  /* start GC... */
   lua_gc(L, LUA_GCGEN);  /* ...in generational mode */
   if (!(args & has_E)) {  /* no option '-E'? */
+    handle_chunkcache(L);
     if (handle_luainit(L) != LUA_OK)  /* run LUA_INIT */
       return 0;  /* error running LUA_INIT */
   }
@@ -259,6 +259,7 @@ LUA_API const char *(lua_pushvfstring)  (lua_State *L, const char *fmt,
                                                       va_list argp);
 LUA_API const char *(lua_pushfstring)        (lua_State *L, const char *fmt, ...);
 LUA_API void        (lua_pushcclosure)       (lua_State *L, lua_CFunction fn, int n);
+LUA_API void        (lua_pushleaf)           (lua_State *L, lua_CFunction fn, int nargs);
 LUA_API void        (lua_pushboolean)        (lua_State *L, int b);
 LUA_API void        (lua_pushlightuserdata)  (lua_State *L, void *p);
 LUA_API int         (lua_pushthread)         (lua_State *L);
@@ -460,6 +461,9 @@ LUA_API int   (lua_load)  (lua_State *L, lua_Reader reader, void *dt,
 
 LUA_API int   (lua_dump)  (lua_State *L, lua_Writer writer, void *data, int strip);
 
+/* flag for 'strip' in 'lua_dump': load nested functions only when needed */
+constexpr inline int LUA_DUMPLAZY = 2;
+
 
 /*
 ** coroutine functions
@@ -496,6 +500,13 @@ constexpr inline int LUA_GCISRUNNING = 6;
 constexpr inline int LUA_GCGEN		 = 7;
 constexpr inline int LUA_GCINC		 = 8;
 constexpr inline int LUA_GCPARAM     = 9;
+constexpr inline int LUA_GCLIMIT     = 10;
+constexpr inline int LUA_GCLIMITHITS = 11;
+constexpr inline int LUA_GCDEFERFIN  = 12;
+constexpr inline int LUA_GCRUNFIN    = 13;
+constexpr inline int LUA_GCTHREADPOOL   = 14;
+constexpr inline int LUA_GCTHREADHITS   = 15;
+constexpr inline int LUA_GCTHREADMISSES = 16;
 
 
 /*
@@ -533,14 +544,33 @@ constexpr inline int LUA_GCPN = 6;
  * @brief `LUA_GCSTEP(int stepsize)`: Performs an incremental step of garbage collection, corresponding to the allocation of stepsize Kbytes.
  * @brief `LUA_GCINC(int pause, int stepmul, stepsize)`: Changes the collector to incremental mode with the given parameters (see §2.5.1). Returns the previous mode (`LUA_GCGEN` or `LUA_GCINC`).
  * @brief `LUA_GCGEN(int minormul, int majormul)`: Changes the collector to generational mode with the given parameters (see §2.5.2). Returns the previous mode (`LUA_GCGEN` or `LUA_GCINC`).
+ * @brief `LUA_GCLIMIT(int limit)`: Sets a hard limit (in Kbytes, 0 for no limit, negative to keep the current one) for the memory in use by Lua. An allocation that would exceed it first triggers an emergency collection and then fails with `LUA_ERRMEM`. Returns the previous limit.
+ * @brief `LUA_GCLIMITHITS`: Returns the number of allocations refused because of the memory limit.
+ * @brief `LUA_GCDEFERFIN(int on)`: If on is 1, the collector stops calling finalizers; objects to be finalized are queued until `lua_runfinalizers` is called. If on is 0, finalizers run during collections again. A negative value only queries. Returns the previous setting.
+ * @brief `LUA_GCRUNFIN(int budget)`: Same as `lua_runfinalizers`.
+ * @brief `LUA_GCTHREADPOOL(int size)`: Sets the maximum number of collected threads kept to be reused by `lua_newthread` (0 disables the pool, negative keeps the current size). Returns the previous size.
+ * @brief `LUA_GCTHREADHITS`: Returns the number of threads created by reusing a pooled thread.
+ * @brief `LUA_GCTHREADMISSES`: Returns the number of threads created anew.
  * 
  * @param what The action (`LUA_GC...`).
- * @param ... The arguments for the action, for `LUA_GCSTEP`,`LUA_GCINC` and `LUA_GCGEN`
+ * @param ... The arguments for the action, for `LUA_GCSTEP`,`LUA_GCINC`, `LUA_GCGEN`, `LUA_GCLIMIT`, `LUA_GCDEFERFIN`, `LUA_GCRUNFIN` and `LUA_GCTHREADPOOL`
  * @returns Depends on the action.
  * @returns -1 on error, 0 by default.
  */
 LUA_API int (lua_gc) (lua_State *L, int what, ...);
 
+/**
+ * @brief Calls pending finalizers (`__gc` metamethods) of objects already
+ * @brief collected, at most budget of them (all of them if budget is negative).
+ * @brief With `LUA_GCDEFERFIN` on, this is the only place where finalizers
+ * @brief run, besides `lua_close`, which always calls all of them.
+ * 
+ * @brief Like `lua_gc`, this function should not be called by a finalizer.
+ * 
+ * @returns The number of finalizers called.
+ */
+LUA_API int (lua_runfinalizers) (lua_State *L, int budget);
+
 
 /*
 ** miscellaneous functions
@@ -678,6 +708,16 @@ LUA_API int      (lua_gethookmask)  (lua_State *L);
 LUA_API int      (lua_gethookcount) (lua_State *L);
 
 
+/*
+** What to do when the fuel runs out (see 'lua_setfuel')
+*/
+constexpr inline int LUA_FUELERROR = 0;
+constexpr inline int LUA_FUELYIELD = 1;
+
+LUA_API void        (lua_setfuel) (lua_State *L, lua_Integer fuel, int mode);
+LUA_API lua_Integer (lua_getfuel) (lua_State *L);
+
+
 struct lua_Debug {
   int event;
   const char *name;	    	    /* (n) */
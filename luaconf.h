@@ -87,6 +87,23 @@
 #endif
 
 
+/*
+@@ LUA_USE_LOSPACE makes Lua allocate large blocks (strings, table
+** parts, etc.) directly from the system with 'mmap', bypassing the
+** allocation function (see 'lmem.c'). It needs a Posix system.
+*/
+/* #define LUA_USE_LOSPACE */
+
+
+/*
+@@ LUA_USE_MAPSTACK makes large Lua stacks live in address space
+** reserved with 'mmap' for the maximum stack size, where they grow and
+** shrink in place, without being copied (see 'ldo.c'). It needs a
+** Posix system.
+*/
+/* #define LUA_USE_MAPSTACK */
+
+
 /*
 @@ LUAI_IS32INT is true iff 'int' has (at least) 32 bits.
 */
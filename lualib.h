@@ -54,6 +54,10 @@ LUAMOD_API int (luaopen_table) (lua_State *L);
 constexpr inline int LUA_UTF8LIBK = LUA_TABLIBK << 1;
 LUAMOD_API int (luaopen_utf8) (lua_State *L);
 
+#define LUA_SCHEDLIBNAME	"sched"
+constexpr inline int LUA_SCHEDLIBK = LUA_UTF8LIBK << 1;
+LUAMOD_API int (luaopen_sched) (lua_State *L);
+
 
 /* open selected libraries */
 LUALIB_API void (luaL_openselectedlibs) (lua_State *L, int load, int preload);
@@ -39,6 +39,7 @@ typedef struct {
   size_t offset;  /* current position relative to beginning of dump */
   lua_Integer nstr;  /* number of strings in the list */
   lu_byte fixed;  /* dump is fixed in memory */
+  lu_byte lazy;  /* nested functions are loaded on demand */
 } LoadState;
 
 
@@ -247,6 +248,29 @@ static void loadConstants (LoadState *S, Proto *f) {
 }
 
 
+/*
+** Load a nested function in the lazy format: keep its encoded body
+** (in place, for a fixed buffer) to be decoded by 'luaU_loadlazy'.
+*/
+static void loadLazy (LoadState *S, Proto *f) {
+  size_t size = loadSize(S);
+  if (size > cast_sizet(INT_MAX))
+    error(S, "function too large");
+  loadAlign(S, LUAC_LAZYALIGN);
+  f->flag = PF_LAZY;
+  if (S->fixed) {
+    f->flag |= PF_FIXED;
+    f->lineinfo = getaddr(S, size, ls_byte);
+    f->sizelineinfo = cast_int(size);
+  }
+  else {
+    f->lineinfo = luaM_newvectorchecked(S->L, size, ls_byte);
+    f->sizelineinfo = cast_int(size);
+    loadVector(S, f->lineinfo, size);
+  }
+}
+
+
 static void loadProtos (LoadState *S, Proto *f) {
   unsigned i;
   unsigned n = loadUint(S);
@@ -257,7 +281,10 @@ static void loadProtos (LoadState *S, Proto *f) {
   for (i = 0; i < n; i++) {
     f->p[i] = luaF_newproto(S->L);
     luaC_objbarrier(S->L, f, f->p[i]);
-    loadFunction(S, f->p[i]);
+    if (S->lazy)
+      loadLazy(S, f->p[i]);
+    else
+      loadFunction(S, f->p[i]);
   }
 }
 
@@ -339,6 +366,13 @@ static void loadFunction (LoadState *S, Proto *f) {
   loadUpvalues(S, f);
   loadProtos(S, f);
   loadString(S, f, &f->source);
+  if (S->lazy && f->source != NULL) {  /* lazy functions need the source */
+    int i;
+    for (i = 0; i < f->sizep; i++) {
+      f->p[i]->source = f->source;
+      luaC_objbarrier(S->L, f->p[i], f->source);
+    }
+  }
   loadDebug(S, f);
 }
 
@@ -365,8 +399,11 @@ static void checkHeader (LoadState *S) {
   checkliteral(S, &LUA_SIGNATURE[1], "not a binary chunk");
   if (loadByte(S) != LUAC_VERSION)
     error(S, "version mismatch");
-  if (loadByte(S) != LUAC_FORMAT)
-    error(S, "format mismatch");
+  switch (loadByte(S)) {
+    case LUAC_FORMAT: S->lazy = 0; break;
+    case LUAC_FORMATLAZY: S->lazy = 1; break;
+    default: error(S, "format mismatch");
+  }
   checkliteral(S, LUAC_DATA, "corrupted chunk");
   checksize(S, Instruction);
   checksize(S, lua_Integer);
@@ -378,18 +415,23 @@ static void checkHeader (LoadState *S) {
 }
 
 
+static const char *chunkname (const char *name) {
+  if (*name == '@' || *name == '=')
+    return name + 1;
+  else if (*name == LUA_SIGNATURE[0])
+    return "binary string";
+  else
+    return name;
+}
+
+
 /*
 ** Load precompiled chunk.
 */
 LClosure *luaU_undump (lua_State *L, ZIO *Z, const char *name, int fixed) {
   LoadState S;
   LClosure *cl;
-  if (*name == '@' || *name == '=')
-    S.name = name + 1;
-  else if (*name == LUA_SIGNATURE[0])
-    S.name = "binary string";
-  else
-    S.name = name;
+  S.name = chunkname(name);
   S.L = L;
   S.Z = Z;
   S.fixed = cast_byte(fixed);
@@ -411,3 +453,46 @@ LClosure *luaU_undump (lua_State *L, ZIO *Z, const char *name, int fixed) {
   return cl;
 }
 
+
+/*
+** Decode the body of lazy prototype 'p->p[i]'. The body goes into a
+** new prototype, which replaces the lazy one in 'p' only after it is
+** completely loaded, so that an error leaves 'p' unchanged. Returns
+** the new prototype.
+*/
+Proto *luaU_loadlazy (lua_State *L, Proto *p, int i) {
+  Proto *lp = p->p[i];
+  LoadState S;
+  ZIO z;
+  LClosure *cl;
+  Proto *f;
+  lua_assert(lp->flag & PF_LAZY);
+  luaZ_initmem(L, &z, cast_charp(lp->lineinfo), cast_sizet(lp->sizelineinfo));
+  S.name = (lp->source != NULL) ? chunkname(getstr(lp->source)) : "?";
+  S.L = L;
+  S.Z = &z;
+  S.fixed = cast_byte((lp->flag & PF_FIXED) != 0);
+  S.lazy = 1;
+  S.offset = 0;  /* body starts aligned */
+  cl = luaF_newLclosure(L, 0);  /* to anchor the new prototype */
+  setclLvalue2s(L, L->top.p, cl);
+  luaD_inctop(L);
+  S.h = luaH_new(L);  /* create list of saved strings */
+  S.nstr = 0;
+  sethvalue2s(L, L->top.p, S.h);  /* anchor it */
+  luaD_inctop(L);
+  if (lp->source != NULL) {  /* source is the first saved string */
+    TValue sv;
+    setsvalue(L, &sv, lp->source);
+    luaH_setint(L, S.h, ++S.nstr, &sv);
+  }
+  f = cl->p = luaF_newproto(L);
+  luaC_objbarrier(L, cl, f);
+  loadFunction(&S, f);
+  luai_verifycode(L, f);
+  p->p[i] = f;  /* replace lazy prototype */
+  luaC_objbarrier(L, p, f);
+  L->top.p -= 2;  /* pop closure and table */
+  return f;
+}
+
@@ -27,10 +27,21 @@ constexpr inline int LUAC_VERSION = (LUA_VERSION_MAJOR_N * 16 + LUA_VERSION_MINO
 
 constexpr inline int LUAC_FORMAT = 0;	/* this is the official format */
 
+/*
+** Format where nested functions are loaded on demand: each one is a
+** block, preceded by its size, that is only decoded when the function
+** is first needed (see 'luaU_loadlazy'). Blocks start aligned to
+** LUAC_LAZYALIGN and have their own list of saved strings, where index 1
+** is the source of the enclosing function.
+*/
+constexpr inline int LUAC_FORMATLAZY = 1;
+constexpr inline int LUAC_LAZYALIGN = sizeof(lua_Integer);
+
 
 /* load one chunk; from lundump.c */
 LUAI_FUNC LClosure* luaU_undump (lua_State* L, ZIO* Z, const char* name,
                                                int fixed);
+LUAI_FUNC Proto* luaU_loadlazy (lua_State* L, Proto* p, int i);
 
 /* dump one chunk; from ldump.c */
 LUAI_FUNC int luaU_dump (lua_State* L, const Proto* f, lua_Writer w,
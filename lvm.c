@@ -29,6 +29,7 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "lundump.h"
 #include "lvm.h"
 
 
@@ -286,14 +287,18 @@ static int floatforloop (StkId ra) {
 
 
 /*
-** Finish the table access 'val = t[key]' and return the tag of the result.
+** Follow the '__index' chain for 't[key]'. If that ends in a function,
+** return it, with '*pt' set to the object being indexed. Otherwise,
+** the result is already in 'val', its tag in '*tag', and it returns
+** NULL.
 */
-lu_byte luaV_finishget (lua_State *L, const TValue *t, TValue *key,
-                                      StkId val, lu_byte tag) {
+static const TValue *indexchain (lua_State *L, const TValue **pt,
+                                 TValue *key, StkId val, lu_byte *tag) {
   int loop;  /* counter to avoid infinite loops */
+  const TValue *t = *pt;
   const TValue *tm;  /* metamethod */
   for (loop = 0; loop < MAXTAGLOOP; loop++) {
-    if (tag == LUA_VNOTABLE) {  /* 't' is not a table? */
+    if (*tag == LUA_VNOTABLE) {  /* 't' is not a table? */
       lua_assert(!ttistable(t));
       tm = luaT_gettmbyobj(L, t, TM_INDEX);
       if (l_unlikely(notm(tm)))
@@ -304,31 +309,47 @@ lu_byte luaV_finishget (lua_State *L, const TValue *t, TValue *key,
       tm = fasttm(L, hvalue(t)->metatable, TM_INDEX);  /* table's metamethod */
       if (tm == NULL) {  /* no metamethod? */
         setnilvalue(s2v(val));  /* result is nil */
-        return LUA_VNIL;
+        *tag = LUA_VNIL;
+        return NULL;
       }
       /* else will try the metamethod */
     }
     if (ttisfunction(tm)) {  /* is metamethod a function? */
-      tag = luaT_callTMres(L, tm, t, key, val);  /* call it */
-      return tag;  /* return tag of the result */
+      *pt = t;
+      return tm;  /* caller must call it */
     }
     t = tm;  /* else try to access 'tm[key]' */
-    luaV_fastget(t, key, s2v(val), luaH_get, tag);
-    if (!tagisempty(tag))
-      return tag;  /* done */
-    /* else repeat (tail call 'luaV_finishget') */
+    luaV_fastget(t, key, s2v(val), luaH_get, *tag);
+    if (!tagisempty(*tag))
+      return NULL;  /* done */
+    /* else repeat (tail call 'indexchain') */
   }
   luaG_runerror(L, LUACC_SINGLE_STRING("__index") " chain too long; possible loop");
-  return 0;  /* to avoid warnings */
+  return NULL;  /* to avoid warnings */
 }
 
 
 /*
-** Finish a table assignment 't[key] = val'.
+** Finish the table access 'val = t[key]' and return the tag of the result.
 */
-void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
-                      TValue *val, int hres) {
+lu_byte luaV_finishget (lua_State *L, const TValue *t, TValue *key,
+                                      StkId val, lu_byte tag) {
+  const TValue *tm = indexchain(L, &t, key, val, &tag);
+  if (tm != NULL)  /* must call a metamethod? */
+    tag = luaT_callTMres(L, tm, t, key, val);  /* call it */
+  return tag;
+}
+
+
+/*
+** Follow the '__newindex' chain for 't[key] = val'. If that ends in a
+** function, return it, with '*pt' set to the object being indexed.
+** Otherwise, do the assignment and return NULL.
+*/
+static const TValue *newindexchain (lua_State *L, const TValue **pt,
+                                    TValue *key, TValue *val, int hres) {
   int loop;  /* counter to avoid infinite loops */
+  const TValue *t = *pt;
   for (loop = 0; loop < MAXTAGLOOP; loop++) {
     const TValue *tm;  /* '__newindex' metamethod */
     if (hres != HNOTATABLE) {  /* is 't' a table? */
@@ -338,7 +359,7 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
         luaH_finishset(L, h, key, val, hres);  /* set new value */
         invalidateTMcache(h);
         luaC_barrierback(L, obj2gco(h), val);
-        return;
+        return NULL;
       }
       /* else will try the metamethod */
     }
@@ -349,16 +370,28 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
     }
     /* try the metamethod */
     if (ttisfunction(tm)) {
-      luaT_callTM(L, tm, t, key, val);
-      return;
+      *pt = t;
+      return tm;  /* caller must call it */
     }
     t = tm;  /* else repeat assignment over 'tm' */
     luaV_fastset(t, key, val, hres, luaH_pset);
     if (hres == HOK)
-      return;  /* done */
-    /* else 'return luaV_finishset(L, t, key, val, slot)' (loop) */
+      return NULL;  /* done */
+    /* else 'return newindexchain(L, t, key, val, hres)' (loop) */
   }
   luaG_runerror(L, LUACC_SINGLE_STRING("__newindex") " chain too long; possible loop");
+  return NULL;  /* to avoid warnings */
+}
+
+
+/*
+** Finish a table assignment 't[key] = val'.
+*/
+void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
+                      TValue *val, int hres) {
+  const TValue *tm = newindexchain(L, &t, key, val, hres);
+  if (tm != NULL)  /* must call a metamethod? */
+    luaT_callTM(L, tm, t, key, val);
 }
 
 
@@ -786,6 +819,32 @@ lua_Integer luaV_shiftl (lua_Integer x, lua_Integer y) {
 ** create a new Lua closure, push it in the stack, and initialize
 ** its upvalues.
 */
+/*
+** check whether cached closure in prototype 'p' may be reused, that is,
+** whether there is a cached closure with the same upvalues needed by
+** new closure to be created.
+*/
+static LClosure *getcached (Proto *p, UpVal **encup, StkId base) {
+  LClosure *c = p->cache;
+  if (c != NULL) {  /* is there a cached closure? */
+    int nup = p->sizeupvalues;
+    Upvaldesc *uv = p->upvalues;
+    int i;
+    for (i = 0; i < nup; i++) {  /* check whether it has right upvalues */
+      TValue *v = uv[i].instack ? s2v(base + uv[i].idx) : encup[uv[i].idx]->v.p;
+      if (c->upvals[i]->v.p != v)
+        return NULL;  /* wrong upvalue; cannot reuse closure */
+    }
+  }
+  return c;  /* return cached closure (or NULL if no cached closure) */
+}
+
+
+/*
+** create a new Lua closure, push it in the stack, and initialize
+** its upvalues. The new closure goes to the prototype's cache; as the
+** prototype may be already black, it needs a (backward) barrier.
+*/
 static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
                          StkId ra) {
   int nup = p->sizeupvalues;
@@ -801,8 +860,94 @@ static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
       ncl->upvals[i] = encup[uv[i].idx];
     luaC_objbarrier(L, ncl, ncl->upvals[i]);
   }
+  luaC_objbarrierback(L, obj2gco(p), obj2gco(ncl));
+  p->cache = ncl;  /* save it on cache for reuse */
+}
+
+
+/*
+** Check whether a call to 'f' passing 'b' - 1 arguments and wanting
+** 'nresults' results can go directly to a leaf C function.
+*/
+#define isleafcall(L,f,b,nresults)  \
+	(ttisCclosure(f) && clCvalue(f)->leaf == (b) &&  \
+	 cast_uint(nresults) <= 1 && !(L)->hookmask)
+
+
+/*
+** Check whether instruction 'i' (an OP_VARARG) and the next one, 'ni',
+** are a 'return f(...)' in a vararg function without fixed parameters.
+** In that case, the extra arguments are already where the tail call
+** would move them: right above the real 'func' of the function.
+*/
+l_sinline int isforward (Instruction i, Instruction ni) {
+  return (GETARG_C(i) == 0 && GET_OPCODE(ni) == OP_TAILCALL &&
+          GETARG_A(ni) + 1 == GETARG_A(i) && GETARG_B(ni) == 0 &&
+          GETARG_C(ni) == 1 && !TESTARG_k(ni));
+}
+
+
+/*
+** {==================================================================
+** Metamethods called by the interpreter
+** ===================================================================
+*/
+
+/*
+** Call metamethod 'tm' for the instruction being executed, with
+** arguments 'p1', 'p2', and 'p3' (only for '__newindex'; otherwise
+** the result goes to 'res'). A Lua function is not called here: its
+** call is only prepared and its 'CallInfo' returned, for the caller's
+** 'luaV_execute' to run it without recursion in C. When it returns,
+** 'luaV_finishOp' completes the instruction, as after a yield.
+*/
+static CallInfo *callTM (lua_State *L, const TValue *tm, const TValue *p1,
+                         const TValue *p2, const TValue *p3, StkId res) {
+  if (ttisLclosure(tm)) {
+    StkId func = L->top.p;
+    CallInfo *ci;
+    setobj2s(L, func, tm);  /* push function (assume EXTRA_STACK) */
+    setobj2s(L, func + 1, p1);  /* 1st argument */
+    setobj2s(L, func + 2, p2);  /* 2nd argument */
+    L->top.p = func + 3;
+    if (p3 != NULL)
+      setobj2s(L, L->top.p++, p3);  /* 3rd argument */
+    ci = luaD_precall(L, func, (p3 != NULL) ? 0 : 1);
+    ci->callstatus |= CIST_TM;
+    return ci;
+  }
+  else if (p3 != NULL)
+    luaT_callTM(L, tm, p1, p2, p3);
+  else
+    luaT_callTMres(L, tm, p1, p2, res);
+  return NULL;  /* metamethod already called */
+}
+
+
+/* 'luaV_finishget' for the interpreter */
+static CallInfo *callgetTM (lua_State *L, const TValue *t, TValue *key,
+                                          StkId val, lu_byte tag) {
+  const TValue *tm = indexchain(L, &t, key, val, &tag);
+  return (tm == NULL) ? NULL : callTM(L, tm, t, key, NULL, val);
+}
+
+
+/* 'luaV_finishset' for the interpreter */
+static CallInfo *callsetTM (lua_State *L, const TValue *t, TValue *key,
+                                          TValue *val, int hres) {
+  const TValue *tm = newindexchain(L, &t, key, val, hres);
+  return (tm == NULL) ? NULL : callTM(L, tm, t, key, val, NULL);
+}
+
+
+/* 'luaT_trybinTM' for the interpreter */
+static CallInfo *callbinTM (lua_State *L, const TValue *p1,
+                            const TValue *p2, StkId res, TMS event) {
+  return callTM(L, luaT_binTM(L, p1, p2, event), p1, p2, NULL, res);
 }
 
+/* }================================================================== */
+
 
 /*
 ** finish execution of an opcode interrupted by a yield
@@ -1084,8 +1229,26 @@ void luaV_finishOp (lua_State *L) {
 #define dojump(ci,i,e)	{ pc += GETARG_sJ(i) + e; updatetrap(ci); }
 
 
+/*
+** use one unit of fuel (see 'lua_setfuel'); if the thread yields for
+** lack of fuel, it resumes repeating the instruction before 'p'
+*/
+#define usefuel(L,p)  \
+	{ if (l_unlikely(--G(L)->fuel < 0)) luaG_nofuel(L, p); }
+
+/*
+** calls use fuel only when they call a Lua function, so that the host
+** can still call C functions (e.g., to reset the fuel) after it ran out
+*/
+#define usecallfuel(L,f,p)  \
+	{ if (ttisLclosure(s2v(f))) usefuel(L, p); }
+
+
 /* for test instructions, execute the jump instruction that follows it */
-#define donextjump(ci)	{ Instruction ni = *pc; dojump(ci, ni, 1); }
+#define donextjump(ci)  \
+	{ Instruction ni = *pc;  \
+	  if (GETARG_sJ(ni) < 0) usefuel(L, pc + 1);  /* back edge? */  \
+	  dojump(ci, ni, 1); }
 
 /*
 ** do a conditional jump: skip next instruction if 'cond' is not what
@@ -1123,6 +1286,15 @@ void luaV_finishOp (lua_State *L) {
 */
 #define halfProtect(exp)  (savestate(L,ci), (exp))
 
+/*
+** Protect a call to a metamethod that may return the 'CallInfo' of a
+** Lua function to be run in this same C frame (see 'callTM').
+*/
+#define ProtectTM(exp)  \
+	{ CallInfo *newci; savestate(L,ci); \
+	  if ((newci = (exp)) != NULL) { ci = newci; goto startfunc; } \
+	  updatetrap(ci); }
+
 /*
 ** macro executed during Lua functions at points where the
 ** function can yield.
@@ -1258,7 +1430,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         lu_byte tag;
         luaV_fastget(upval, key, s2v(ra), luaH_getshortstr, tag);
         if (tagisempty(tag))
-          Protect(luaV_finishget(L, upval, rc, ra, tag));
+          ProtectTM(callgetTM(L, upval, rc, ra, tag));
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
@@ -1272,7 +1444,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         else
           luaV_fastget(rb, rc, s2v(ra), luaH_get, tag);
         if (tagisempty(tag))
-          Protect(luaV_finishget(L, rb, rc, ra, tag));
+          ProtectTM(callgetTM(L, rb, rc, ra, tag));
         vmbreak;
       }
       vmcase(OP_GETI) {
@@ -1284,7 +1456,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         if (tagisempty(tag)) {
           TValue key;
           setivalue(&key, c);
-          Protect(luaV_finishget(L, rb, &key, ra, tag));
+          ProtectTM(callgetTM(L, rb, &key, ra, tag));
         }
         vmbreak;
       }
@@ -1296,7 +1468,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         lu_byte tag;
         luaV_fastget(rb, key, s2v(ra), luaH_getshortstr, tag);
         if (tagisempty(tag))
-          Protect(luaV_finishget(L, rb, rc, ra, tag));
+          ProtectTM(callgetTM(L, rb, rc, ra, tag));
         vmbreak;
       }
       vmcase(OP_SETTABUP) {
@@ -1305,11 +1477,12 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a short string */
+        luaV_watchset(L, key);
         luaV_fastset(upval, key, rc, hres, luaH_psetshortstr);
         if (hres == HOK)
           luaV_finishfastset(L, upval, rc);
         else
-          Protect(luaV_finishset(L, upval, rb, rc, hres));
+          ProtectTM(callsetTM(L, upval, rb, rc, hres));
         vmbreak;
       }
       vmcase(OP_SETTABLE) {
@@ -1321,12 +1494,14 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
           luaV_fastseti(s2v(ra), ivalue(rb), rc, hres);
         }
         else {
+          if (ttisstring(rb))
+            luaV_watchset(L, tsvalue(rb));
           luaV_fastset(s2v(ra), rb, rc, hres, luaH_pset);
         }
         if (hres == HOK)
           luaV_finishfastset(L, s2v(ra), rc);
         else
-          Protect(luaV_finishset(L, s2v(ra), rb, rc, hres));
+          ProtectTM(callsetTM(L, s2v(ra), rb, rc, hres));
         vmbreak;
       }
       vmcase(OP_SETI) {
@@ -1340,7 +1515,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         else {
           TValue key;
           setivalue(&key, b);
-          Protect(luaV_finishset(L, s2v(ra), &key, rc, hres));
+          ProtectTM(callsetTM(L, s2v(ra), &key, rc, hres));
         }
         vmbreak;
       }
@@ -1350,11 +1525,12 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a short string */
+        luaV_watchset(L, key);
         luaV_fastset(s2v(ra), key, rc, hres, luaH_psetshortstr);
         if (hres == HOK)
           luaV_finishfastset(L, s2v(ra), rc);
         else
-          Protect(luaV_finishset(L, s2v(ra), rb, rc, hres));
+          ProtectTM(callsetTM(L, s2v(ra), rb, rc, hres));
         vmbreak;
       }
       vmcase(OP_NEWTABLE) {
@@ -1387,7 +1563,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         setobj2s(L, ra + 1, rb);
         luaV_fastget(rb, key, s2v(ra), luaH_getstr, tag);
         if (tagisempty(tag))
-          Protect(luaV_finishget(L, rb, rc, ra, tag));
+          ProtectTM(callgetTM(L, rb, rc, ra, tag));
         vmbreak;
       }
       vmcase(OP_ADDI) {
@@ -1513,17 +1689,21 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TMS tm = (TMS)GETARG_C(i);
         StkId result = RA(pi);
         lua_assert(OP_ADD <= GET_OPCODE(pi) && GET_OPCODE(pi) <= OP_SHR);
-        Protect(luaT_trybinTM(L, s2v(ra), rb, result, tm));
+        ProtectTM(callbinTM(L, s2v(ra), rb, result, tm));
         vmbreak;
       }
       vmcase(OP_MMBINI) {
         StkId ra = RA(i);
         Instruction pi = *(pc - 2);  /* original arith. expression */
-        int imm = GETARG_sB(i);
+        TValue imm;
         TMS tm = (TMS)GETARG_C(i);
         int flip = GETARG_k(i);
         StkId result = RA(pi);
-        Protect(luaT_trybiniTM(L, s2v(ra), imm, flip, result, tm));
+        setivalue(&imm, GETARG_sB(i));
+        if (flip)  /* arguments were exchanged? */
+          ProtectTM(callbinTM(L, &imm, s2v(ra), result, tm))
+        else
+          ProtectTM(callbinTM(L, s2v(ra), &imm, result, tm))
         vmbreak;
       }
       vmcase(OP_MMBINK) {
@@ -1533,7 +1713,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TMS tm = (TMS)GETARG_C(i);
         int flip = GETARG_k(i);
         StkId result = RA(pi);
-        Protect(luaT_trybinassocTM(L, s2v(ra), imm, flip, result, tm));
+        if (flip)  /* arguments were exchanged? */
+          ProtectTM(callbinTM(L, imm, s2v(ra), result, tm))
+        else
+          ProtectTM(callbinTM(L, s2v(ra), imm, result, tm))
         vmbreak;
       }
       vmcase(OP_UNM) {
@@ -1548,7 +1731,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
           setfltvalue(s2v(ra), luai_numunm(L, nb));
         }
         else
-          Protect(luaT_trybinTM(L, rb, rb, ra, TM_UNM));
+          ProtectTM(callbinTM(L, rb, rb, ra, TM_UNM));
         vmbreak;
       }
       vmcase(OP_BNOT) {
@@ -1559,7 +1742,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
           setivalue(s2v(ra), intop(^, ~l_castS2U(0), ib));
         }
         else
-          Protect(luaT_trybinTM(L, rb, rb, ra, TM_BNOT));
+          ProtectTM(callbinTM(L, rb, rb, ra, TM_BNOT));
         vmbreak;
       }
       vmcase(OP_NOT) {
@@ -1596,6 +1779,8 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_JMP) {
+        if (GETARG_sJ(i) < 0)  /* back edge? */
+          usefuel(L, pc);
         dojump(ci, i, 0);
         vmbreak;
       }
@@ -1674,11 +1859,16 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         CallInfo *newci;
         int b = GETARG_B(i);
         int nresults = GETARG_C(i) - 1;
+        usecallfuel(L, ra, pc);
         if (b != 0)  /* fixed number of arguments? */
           L->top.p = ra + b;  /* top signals number of arguments */
         /* else previous instruction set top */
         savepc(L);  /* in case of errors */
-        if ((newci = luaD_precall(L, ra, nresults)) == NULL)
+        if (isleafcall(L, s2v(ra), b, nresults)) {
+          luaD_callleaf(L, ra, nresults);
+          updatetrap(ci);
+        }
+        else if ((newci = luaD_precall(L, ra, nresults)) == NULL)
           updatetrap(ci);  /* C call; nothing else to be done */
         else {  /* Lua call: run function in this same C frame */
           ci = newci;
@@ -1692,7 +1882,8 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         int n;  /* number of results when calling a C function */
         int nparams1 = GETARG_C(i);
         /* delta is virtual 'func' - real 'func' (vararg functions) */
-        int delta = (nparams1) ? ci->u.l.nextraargs + nparams1 : 0;
+        int delta = (nparams1) ? luaT_vadelta(ci, nparams1) : 0;
+        usecallfuel(L, ra, pc);
         if (b != 0)
           L->top.p = ra + b;
         else  /* previous instruction set top */
@@ -1728,7 +1919,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
           updatestack(ci);
         }
         if (nparams1)  /* vararg function? */
-          ci->func.p -= ci->u.l.nextraargs + nparams1;
+          ci->func.p -= luaT_vadelta(ci, nparams1);
         L->top.p = ra + n;  /* set call for 'luaD_poscall' */
         luaD_poscall(L, ci, n);
         updatetrap(ci);  /* 'luaD_poscall' can change hooks */
@@ -1776,12 +1967,18 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         if (ci->callstatus & CIST_FRESH)
           return;  /* end this frame */
         else {
+          l_uint32 istm = ci->callstatus & CIST_TM;
           ci = ci->previous;
+          if (istm) {  /* returning from a metamethod? */
+            luaV_finishOp(L);  /* finish the instruction that called it */
+            updatetrap(ci);
+          }
           goto returning;  /* continue running caller in this frame */
         }
       }
       vmcase(OP_FORLOOP) {
         StkId ra = RA(i);
+        usefuel(L, pc);
         if (ttisinteger(s2v(ra + 1))) {  /* integer loop? */
           lua_Unsigned count = l_castS2U(ivalue(s2v(ra)));
           if (count > 0) {  /* still more iterations? */
@@ -1846,8 +2043,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
       vmcase(OP_TFORLOOP) {
        l_tforloop: {
         StkId ra = RA(i);
-        if (!ttisnil(s2v(ra + 3)))  /* continue loop? */
+        if (!ttisnil(s2v(ra + 3))) {  /* continue loop? */
+          usefuel(L, pc);
           pc -= GETARG_Bx(i);  /* jump back */
+        }
         vmbreak;
       }}
       vmcase(OP_SETLIST) {
@@ -1879,15 +2078,46 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_CLOSURE) {
-        StkId ra = RA(i);
+        StkId ra;
+        LClosure *ncl;
         Proto *p = cl->p->p[GETARG_Bx(i)];
-        halfProtect(pushclosure(L, p, cl->upvals, base, ra));
-        checkGC(L, ra + 1);
+        if (l_unlikely(p->flag & PF_LAZY)) {  /* body not loaded yet? */
+          Protect(p = luaU_loadlazy(L, cl->p, GETARG_Bx(i)));
+          updatebase(ci);  /* stack may have been reallocated */
+        }
+        ra = RA(i);
+        ncl = getcached(p, cl->upvals, base);  /* cached closure */
+        if (ncl != NULL) {  /* is there a cached closure to reuse? */
+          setclLvalue2s(L, ra, ncl);  /* push it */
+        }
+        else {
+          halfProtect(pushclosure(L, p, cl->upvals, base, ra));
+          checkGC(L, ra + 1);
+        }
         vmbreak;
       }
       vmcase(OP_VARARG) {
         StkId ra = RA(i);
         int n = GETARG_C(i) - 1;  /* required results */
+        if (isforward(i, *pc) && !trap) {  /* 'return f(...)'? */
+          int nextra;
+          StkId func;
+          usecallfuel(L, ra - 1, pc);
+          nextra = ci->u.l.nextraargs;
+          func = ci->func.p - luaT_vadelta(ci, 1);  /* real 'func' */
+          setobjs2s(L, func, ra - 1);  /* 'f' replaces the current function */
+          ci->func.p = func;
+          L->top.p = func + 1 + nextra;  /* arguments are already in place */
+          pc++;  /* skip the OP_TAILCALL */
+          savepc(ci);
+          if ((n = luaD_pretailcall(L, ci, func, nextra + 1, 0)) < 0)
+            goto startfunc;  /* execute the callee */
+          else {  /* C function */
+            luaD_poscall(L, ci, n);  /* finish caller */
+            updatetrap(ci);  /* 'luaD_poscall' can change hooks */
+            goto ret;  /* caller returns after the tail call */
+          }
+        }
         Protect(luaT_getvarargs(L, ci, ra, n));
         vmbreak;
       }
@@ -1904,6 +2134,15 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         lua_assert(0);
         vmbreak;
       }
+      vmcase(OP_HOISTCHECK) {
+        StkId ra = RA(i);
+        lua_Integer epoch = l_castU2S(G(L)->hoistepoch);
+        if (l_unlikely(!ttisinteger(s2v(ra)) || ivalue(s2v(ra)) != epoch)) {
+          setivalue(s2v(ra), epoch);
+          pc += GETARG_sBx(i);  /* go redo the hoisted loads */
+        }
+        vmbreak;
+      }
     }
   }
 }
@@ -99,6 +99,14 @@ typedef enum {
   else { luaH_fastseti(hvalue(t), k, val, hres); }
 
 
+/*
+** A store into a key watched by hoisted loads (see 'luaK_hoist')
+** changes the hoist epoch, so that these loads are done again.
+*/
+#define luaV_watchset(L,ts) \
+  { if (l_unlikely(iswatched(ts))) G(L)->hoistepoch++; }
+
+
 /*
 ** Finish a fast set operation (when fast set succeeds).
 */
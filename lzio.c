@@ -45,6 +45,23 @@ void luaZ_init (lua_State *L, ZIO *z, lua_Reader reader, void *data) {
 }
 
 
+static const char *nullreader (lua_State *L, void *ud, size_t *size) {
+  UNUSED(L); UNUSED(ud);
+  *size = 0;
+  return NULL;
+}
+
+
+/*
+** Initialize a stream over a block already in memory.
+*/
+void luaZ_initmem (lua_State *L, ZIO *z, const char *b, size_t size) {
+  luaZ_init(L, z, nullreader, NULL);
+  z->n = size;
+  z->p = b;
+}
+
+
 /* --------------------------------------------------------------- read --- */
 
 static int checkbuffer (ZIO *z) {
@@ -187,6 +187,7 @@ assert(dofile('events.lua') == 12)
 dofile('vararg.lua')
 dofile('closure.lua')
 dofile('coroutine.lua')
+dofile('sched.lua')
 dofile('goto.lua', true)
 dofile('errors.lua')
 dofile('math.lua')
@@ -585,6 +585,80 @@ do
 end
 
 
+do
+  print("testing parallel compilation of chunks")
+  local chunks = {}
+  local N = 50
+  for i = 1, N do
+    chunks[i] = string.format([[
+      local a = ...
+      local function f (x) return x * %d end
+      return f(a or 1), "%s"
+    ]], i, string.rep("x", i))
+  end
+  chunks[N + 1] = "return 1 +"    -- syntax error
+  chunks[N + 2] = string.dump(load("return 'binary', ..."))
+  local nerr, res = T.loadchunks(chunks)
+  assert(nerr == 1 and #res == 2 * (N + 2))
+  for i = 1, N do
+    local f, st = res[2 * i - 1], res[2 * i]
+    assert(st == 0 and type(f) == "function")
+    local a, b = f(10)
+    assert(a == 10 * i and b == string.rep("x", i))
+  end
+  assert(res[2 * N + 2] ~= 0 and string.find(res[2 * N + 1], "near <eof>"))
+  assert(res[2 * N + 4] == 0 and select(2, res[2 * N + 3](7)) == 7)
+  -- mode is checked against each chunk
+  nerr, res = T.loadchunks({"return 1", chunks[N + 2]}, "b")
+  assert(nerr == 1 and res[2] ~= 0 and string.find(res[1], "text chunk"))
+  assert(res[4] == 0)
+  nerr, res = T.loadchunks({})
+  assert(nerr == 0 and #res == 0)
+end
+
+
+do
+  print("testing prototypes shared among states")
+  local source = {"local X = ..."}
+  local N = 1000
+  for i = 2, N do source[i] = "X = X + 1" end
+  source[N + 1] = "local function inner (y) return y .. X end"
+  source[N + 2] = "if X < 0 then X = X + {} end"    -- error in this line
+  source[N + 3] = string.format("return inner('%s'), X", string.rep("a", 100))
+  source = table.concat(source, "\n")
+  local sc = T.newshared(load(source, "=name1"))
+  collectgarbage(); collectgarbage()
+  local m1 = collectgarbage"count" * 1024
+  local f = T.loadshared(sc)
+  collectgarbage()
+  local m2 = collectgarbage"count" * 1024
+  -- neither the code (more than 3*N instructions) nor the long
+  -- string were copied into the state
+  assert(m2 > m1 and m2 - m1 < 1000)
+  checkerr("name1:1002:", f, -N)    -- line information is shared, too
+  local s, x = f(0)
+  assert(s == string.rep("a", 100) .. (N - 1) and x == N - 1)
+  assert(T.loadshared(sc) ~= f)    -- each load creates a new closure
+
+  -- load the same chunk in other states
+  local L1 = T.newstate()
+  local L2 = T.newstate()
+  T.loadlib(L1, 0, 0); T.loadlib(L2, 0, 0)
+  assert(T.loadshared(sc, L1) == 0 and T.loadshared(sc, L2) == 0)
+  T.releaseshared(sc)    -- states keep the chunk alive
+  local a, b = T.doremote(L1, "return shared(-2000)")
+  assert(a == nil and string.find(b, "name1:1002:"))
+  T.closestate(L1)
+  a, b = T.doremote(L2, "return shared(1)")
+  assert(a == string.rep("a", 100) .. N and b == tostring(N))
+  T.closestate(L2)
+  assert(f(1) == a)    -- still alive in this state
+
+  -- only Lua functions can be shared
+  checkerr("Lua function expected", T.newshared, print)
+end
+
+
 if not _soft then
   collectgarbage("stop")   -- avoid __gc with full stack
   checkerrnopro("pushnum 3; call 0 0", "attempt to call")
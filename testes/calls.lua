@@ -519,6 +519,88 @@ do   -- check reuse of strings in dumps
 end
 
 
+do  print("testing lazy binary chunks")
+  local function gen (k)
+    local x, y = k, {}
+    local function inner (a)
+      local function deep () return a, x, "deep" end
+      y[#y + 1] = a
+      return deep
+    end
+    return inner, function () return #y, x end
+  end
+  for _, strip in ipairs{false, true} do
+    local d = string.dump(gen, strip, true)
+    assert(d ~= string.dump(gen, strip))
+    local g = load(d)
+    local inner, count = g(10)
+    local deep = inner(20)
+    local a, x, s = deep()
+    assert(a == 20 and x == 10 and s == "deep")
+    assert(count() == 1 and select(2, count()) == 10)
+    -- partially loaded functions dump the same as fresh ones
+    assert(string.dump(g, strip, true) == d)
+    assert(load(string.dump(g, strip))(1)(2)() == 2)
+    if not strip then
+      assert(debug.getinfo(deep).source == debug.getinfo(gen).source)
+      assert(debug.getinfo(inner).linedefined ==
+             debug.getinfo(gen).linedefined + 2)
+    end
+  end
+end
+
+
+do  print("testing lazy compilation")
+  local code = [[
+    local a, b = 1, 2
+    local K <const> = 10
+    local t = {}
+    function t.f (x, ...) return a + x + K, select('#', ...) end
+    function t:m (y) return self, y, b end
+    local function rec (n) if n == 0 then return 0 end return n + rec(n - 1) end
+    local function deep (z)
+      return function (w)
+        return function () return a + b + z + w + K end
+      end
+    end
+    local function multi (p,
+       q)
+      local r = p + q
+      return r, nil + p
+    end
+    local function shadow () local K = 3; return K end
+    local function bad () x = = 1 end
+    return t, rec, deep, multi, shadow, bad
+  ]]
+  local t, rec, deep, multi, shadow, bad = load(code, "=lazy", "tL")()
+  local r1, r2 = t.f(5, 1, 2, 3)
+  assert(r1 == 16 and r2 == 3)
+  local s, y, b = t:m(7)
+  assert(s == t and y == 7 and b == 2)
+  assert(rec(10) == 55)
+  assert(deep(3)(4)() == 1 + 2 + 3 + 4 + 10)
+  assert(shadow() == 3)
+  -- debug information before and after the first call
+  local info = debug.getinfo(multi, "SL")
+  assert(info.linedefined == 12 and info.lastlinedefined == 16)
+  assert(info.activelines[14] and info.activelines[15])
+  assert(debug.getlocal(multi, 1) == "p" and debug.getlocal(multi, 2) == "q")
+  local st, msg = pcall(multi, 1, 2)
+  assert(not st and string.find(msg, "^lazy:15:"))
+  -- syntax errors inside functions are raised when they are called
+  st, msg = pcall(bad)
+  assert(not st and string.find(msg, "^lazy:18:"))
+  st, msg = pcall(bad)
+  assert(not st and string.find(msg, "^lazy:18:"))
+  assert(not load("return function () x = 1 until", "=lazy", "tL"))
+  -- functions not compiled yet can be dumped
+  local f = select(3, load(code, "=lazy", "tL")())
+  f = load(string.dump(f))
+  assert(debug.setupvalue(f, 1, 20) and debug.setupvalue(f, 2, 30))
+  assert(f(3)(4)() == 20 + 30 + 3 + 4 + 10)
+end
+
+
 do   -- test limit of multiple returns (254 values)
   local code = "return 10" .. string.rep(",10", 253)
   local res = {assert(load(code))()}
@@ -529,5 +611,172 @@ do   -- test limit of multiple returns (254 values)
   assert(not status and string.find(msg, "too many returns"))
 end
 
+
+if os.tmpname then   print("testing compiled-chunk cache")
+  local reg = debug.getregistry()
+  assert(reg._CHUNKCACHE == nil)
+  local prefix = os.tmpname()
+  local t = {"local M = {}"}
+  for i = 1, 2000 do
+    t[#t + 1] = string.format("function M.f%d (a) return a + %d end", i, i)
+  end
+  t[#t + 1] = "return ..., 'a long constant string' .. string.rep('x', 50)"
+  local code = table.concat(t, "\n")
+  local function timeload ()
+    local c = os.clock()
+    local f = assert(load(code, "=cached"))
+    return os.clock() - c, f
+  end
+  local cold = timeload()
+  local cache = {prefix = prefix}
+  reg._CHUNKCACHE = cache
+  timeload()   -- fills the cache
+  assert(cache.misses == 1 and cache.hits == nil)
+  local file = cache.file
+  local warm, f = timeload()
+  assert(cache.misses == 1 and cache.hits == 1 and cache.file == file)
+  local a, b = f(10)
+  assert(a == 10 and b == 'a long constant string' .. string.rep('x', 50))
+  assert(debug.getinfo(f).source == "=cached")
+  print(string.format("  cold %.4f s, warm %.4f s", cold, warm))
+  -- name is part of the key
+  assert(load(code, "=other"))
+  assert(cache.misses == 2 and cache.file ~= file)
+  assert(os.remove(cache.file))
+  -- binary chunks and chunks in mode 'b' do not use the cache
+  assert(load(string.dump(f)) and load(code, "=cached", "b") == nil)
+  assert(cache.misses == 2 and cache.hits == 1)
+  -- errors are not cached
+  assert(not load("x = ", "=bad"))
+  assert(not load("x = ", "=bad"))
+  assert(cache.misses == 4)
+  reg._CHUNKCACHE = nil
+  assert(os.remove(file))
+  assert(os.remove(prefix))
+end
+
+do   print("testing recovery of protected calls outside coroutines")
+  -- nested calls: each error goes back to its innermost 'pcall'
+  local function f (n)
+    if n == 0 then error({n}) end
+    local st, e = pcall(f, n - 1)
+    assert(not st and e[1] == n - 1)
+    error({n})
+  end
+  local st, e = pcall(f, 20)
+  assert(not st and e[1] == 20)
+
+  -- recovery through metamethods
+  local t = setmetatable({}, {__index = function (t, k)
+    local st, msg = pcall(error, k)
+    return msg .. "!"
+  end, __add = function (a, b)
+    return pcall(function () return {} + b end)
+  end})
+  assert(t.x .. t.y == "x!y!")
+  local st, msg = t + 1
+  assert(st == false)
+
+  -- recovery running pending to-be-closed variables
+  local log = {}
+  local st, msg = pcall(function ()
+    local x <close> = setmetatable({}, {__close = function (_, e)
+      log[#log + 1] = e
+      assert(not pcall(error, 1))   -- a protected call while closing
+      error("in close")
+    end})
+    error("in body")
+  end)
+  assert(not st and string.find(msg, "in close"))
+  assert(#log == 1 and string.find(log[1], "in body"))
+
+  -- message handlers and errors in them
+  local st, msg = xpcall(error, function (m) return m .. "?" end, "a")
+  assert(not st and msg == "a?")
+  local st, msg = xpcall(function ()
+    local st, msg = xpcall(error, error, "b")   -- error in the handler
+    assert(not st and string.find(msg, "error handling"))
+    error("c", 0)
+  end, function (m) return m .. "!" end)
+  assert(not st and msg == "c!")
+
+  -- across C functions that call Lua (their calls cannot be recovered)
+  local a = {3, 1, 2}
+  table.sort(a, function (x, y)
+    assert(not pcall(error, x))
+    return x < y
+  end)
+  assert(a[1] == 1 and a[2] == 2 and a[3] == 3)
+  local st, msg = pcall(table.sort, a, function (x, y)
+    assert(not pcall(error, x))
+    error("in sort")
+  end)
+  assert(not st and string.find(msg, "in sort"))
+
+  -- stack overflow inside a protected call, then back to work
+  local function loop () return 1 + loop() end
+  for i = 1, 3 do
+    local st, msg = pcall(function () return pcall(loop) end)
+    assert(st and not msg)
+  end
+end
+
+do   print("testing growth and shrinking of deep stacks")
+  -- values and open upvalues survive any reallocation of the stack
+  local function deep (n)
+    local x = n
+    local function get () return x end
+    if n == 0 then
+      collectgarbage()   -- may shrink stacks
+      return get
+    end
+    local g = deep(n - 1)
+    assert(get() == n and g() == 0)
+    x = -n
+    assert(get() == -n)
+    return g
+  end
+  for i = 1, 3 do
+    assert(coroutine.wrap(deep)(5000)() == 0)
+  end
+  assert(deep(5000)() == 0)
+  collectgarbage()
+end
+
+do   print("testing leaf C functions")
+  local floor, byte, rawget, type = math.floor, string.byte, rawget, type
+  local s, t = "abc", {10, 20}
+  for i = 1, 3 do
+    assert(floor(i + 0.5) == i and byte(s, i) == 96 + i and s:byte(i) == 96 + i)
+    assert(rawget(t, i) == (i < 3 and i * 10 or nil) and type(i) == "number")
+    local a, b = floor(i + 0.5)   -- adjusted to one result
+    assert(a == i and b == nil)
+    rawset(t, i, i)   -- no results
+  end
+  assert(t[3] == 3 and s:sub(2, 3) == "bc" and s:len() == 3)
+  -- other numbers of arguments and results use regular calls
+  assert(byte(s) == 97 and select('#', byte(s, 1, 3)) == 3)
+  assert(select('#', floor(1.5)) == 1 and select('#', s:byte(10)) == 0)
+  local x = s:byte(10); assert(x == nil)   -- no results adjusted to nil
+  -- errors
+  local function check (msg, f, ...)
+    local st, err = pcall(f, ...)
+    assert(not st and string.find(err, msg))
+  end
+  check("bad argument #1 to 'floor'", function () return (floor({})) end)
+  check("bad argument #2 to 'byte'", function () local x = byte(s, {}) end)
+  check("index is nil", function () rawset(t, nil, 1) end)
+  -- hooks see leaves as regular C functions
+  local calls = {}
+  debug.sethook(function (e)
+    local f = debug.getinfo(2, "f").func
+    if f == floor then calls[#calls + 1] = e end
+  end, "cr")
+  local y = floor(2.5)
+  debug.sethook()
+  assert(y == 2 and calls[1] == "call" and calls[2] == "return")
+  assert(debug.getinfo(floor).what == "C")
+end
+
 print('OK')
 return deep
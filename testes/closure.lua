@@ -274,4 +274,73 @@ assert(not pcall(debug.upvaluejoin, print, 1, foo2, 1))
 assert(not pcall(debug.upvaluejoin, {}, 1, foo2, 1))
 assert(not pcall(debug.upvaluejoin, foo1, 1, print, 1))
 
+do   print("testing many open upvalues")
+  -- closures capture locals from the last to the first, so each new
+  -- upvalue goes to the end of the list of open upvalues
+  local N = 40
+  local names, rev = {}, {}
+  for i = 1, N do names[i] = "a" .. i; rev[N - i + 1] = "a" .. i end
+  local code = string.format([[
+    local grow = ...
+    local %s = %s
+    local fs = {}
+    for i = 1, 3 do
+      fs[i] = function (k, v)
+        if k then %s = v end   -- sets the last local
+        return %s
+      end
+      grow(200)   -- reallocate the stack with all those upvalues open
+    end
+    return fs, function () return %s end
+  ]], table.concat(names, ", "), table.concat(names, ", ", 1, N):gsub("a", ""),
+      names[N], table.concat(rev, " + "), names[1])
+  local function grow (n) if n > 0 then return grow(n - 1) end end
+  local fs, first = assert(load(code))(grow)
+  local sum = N * (N + 1) // 2
+  for i = 1, 3 do
+    assert(fs[i]() == sum)
+    assert(debug.upvalueid(fs[i], 1) == debug.upvalueid(fs[1], 1))
+    assert(debug.upvalueid(fs[i], N) == debug.upvalueid(first, 1))
+  end
+  fs[2](true, 0)   -- all closures share the (now closed) upvalues
+  assert(fs[1]() == sum - N and fs[3]() == sum - N and first() == 1)
+end
+
+do   print("testing closure caching")
+  local function gen (x)
+    return function () return 10 end,     -- no upvalues
+           function () return print end,  -- only '_ENV'
+           function () return x end       -- an upvalue in the stack
+  end
+  local f1, g1, h1 = gen(1)
+  local f2, g2, h2 = gen(2)
+  assert(f1 == f2 and g1 == g2)   -- same upvalues: closures are reused
+  assert(h1 ~= h2 and h1() == 1 and h2() == 2)   -- different upvalues
+
+  local a = {}
+  for i = 1, 3 do a[i] = function () return i end end
+  assert(a[1] ~= a[2] and a[2]() == 2)   -- each 'i' is a new variable
+  local x = 0
+  for i = 1, 3 do a[i] = function () return x end end
+  assert(a[1] == a[2] and a[3] == a[1])   -- all share the same 'x'
+
+  -- a closure whose upvalue was changed cannot be reused
+  local function f () return x end
+  local function mk () return function () return x end end
+  local c1 = mk()
+  debug.upvaluejoin(c1, 1, f, 1)
+  assert(mk() == c1)   -- still the same upvalue
+  local y = 20
+  debug.upvaluejoin(c1, 1, function () return y end, 1)
+  assert(mk() ~= c1 and c1() == 20 and mk()() == 0)
+
+  -- cache does not keep the closure alive
+  local w = setmetatable({}, {__mode = "k"})
+  local function k () return function () end end
+  w[k()] = true
+  assert(k() == next(w))
+  collectgarbage(); collectgarbage()
+  assert(next(w) == nil)
+end
+
 print'OK'
@@ -471,5 +471,156 @@ do   -- basic check for SETLIST
   assert(count == 1)
 end
 
+
+do   print("testing optimizer")
+  local function opt (body)
+    return assert(load("return function " .. body .. " end", "=opt", "tO"))()
+  end
+
+  -- no final return after a return; jumps to returns are returns
+  local f = opt("(a) if a then a = 1 else a = 2 end return a")
+  check(f, 'TEST', 'JMP', 'LOADI', 'RETURN1', 'LOADI', 'RETURN1')
+  assert(f(true) == 1 and f(false) == 2)
+
+  -- repeated read of a global
+  f = opt("() local a, b = X, X; return a + b")
+  check(f, 'GETTABUP', 'MOVE', 'ADD', 'MMBIN', 'RETURN1')
+  X = 10; assert(f() == 20); X = nil
+
+  -- loop whose body always returns
+  f = opt("(n) for i = 1, n do return i end return 0")
+  check(f, 'LOADI', 'MOVE', 'LOADI', 'FORPREP', 'RETURN1', 'FORLOOP',
+           'LOADI', 'RETURN1')
+  assert(f(3) == 1 and f(0) == 0)
+
+  -- line information is kept
+  f = assert(load("return function (a)\n  if a then\n    return 1\n" ..
+                  "  else\n    return a + {}\n  end\nend", "=opt", "tO"))()
+  local lines = debug.getinfo(f, "L").activelines
+  assert(lines[2] and lines[3] and lines[5] and not lines[7])
+  local st, msg = pcall(f, false)
+  assert(not st and string.find(msg, "^opt:5:"))
+end
+
+
+do   print("testing hoisting of loads")
+  local function hoist (body)
+    return assert(load("return function " .. body .. " end", "=hoist", "tH"))()
+  end
+
+  -- reads become moves; loads are redone after checks
+  local f = hoist("(n) local s = 0; for i = 1, n do s = s + math.abs(-i) end return s")
+  check(f, 'LOADI', 'LOADNIL', 'LOADI', 'MOVE', 'LOADI', 'FORPREP',
+           'HOISTCHECK', 'MOVE', 'MOVE', 'UNM', 'CALL', 'HOISTCHECK',
+           'ADD', 'MMBIN', 'FORLOOP', 'JMP',
+           'GETTABUP', 'LOADNIL', 'TEST', 'JMP', 'GETFIELD', 'JMP',
+           'GETTABUP', 'LOADNIL', 'TEST', 'JMP', 'GETFIELD', 'JMP',
+           'RETURN1', 'RETURN0')
+  assert(f(4) == 10)
+
+  -- a key stored inside the loop is not hoisted
+  f = hoist("(n) for i = 1, n do X = X + 1 end")
+  check(f, 'LOADNIL', 'LOADI', 'MOVE', 'LOADI', 'FORPREP', 'JMP',
+           'GETTABUP', 'ADDI', 'MMBINI', 'SETTABUP', 'FORLOOP', 'RETURN0')
+  X = 0; f(5); assert(X == 5)
+
+  -- changes by calls are seen after the call
+  f = hoist([[(n) local t = {}
+    for i = 1, n do
+      t[#t + 1] = X
+      load("X = " .. i)()
+      t[#t + 1] = X
+    end
+    return t]])
+  X = 0
+  local t = f(3)
+  assert(#t == 6 and t[1] == 0 and t[2] == 1 and t[5] == 2 and t[6] == 3)
+
+  -- changes through other tables and computed keys
+  f = hoist([[(n) local t = {}
+    for i = 1, n do
+      t[i] = math.pi
+      if i == 2 then local m = math; m["p" .. "i"] = 3 end
+    end
+    return t]])
+  local pi = math.pi
+  t = f(4)
+  math.pi = pi
+  assert(t[1] == pi and t[2] == pi and t[3] == 3 and t[4] == 3)
+
+  -- only innermost loops hoist; guarded fields of absent values
+  f = hoist([[(n) local s = 0
+    for i = 1, n do
+      for j = 1, n do s = s + math.max(i, j) end
+      if Absent then s = s + Absent.x end
+    end
+    return s]])
+  assert(f(3) == 22)
+
+  -- names in error messages
+  f = hoist("(n) for i = 1, n do math.sinn(i) end")
+  local st, msg = pcall(f, 1)
+  assert(not st and string.find(msg, "field 'sinn'"))
+  f = hoist("(n) for i = 1, n do local a = Absent + 1 end")
+  st, msg = pcall(f, 1)
+  assert(not st and string.find(msg, "global 'Absent'"))
+end
+
+
+do   print("testing inline expansion of calls")
+  local function inl (body)
+    return assert(load(body, "=inl", "tI"))
+  end
+
+  -- a <const> function needs no guard
+  local f = inl("local sq <const> = function (x) return x * x end\n" ..
+                "return sq(...)")
+  check(f, 'VARARGPREP', 'CLOSURE', 'VARARG', 'MUL', 'MMBIN', 'MOVE',
+           'RETURN')
+  assert(f(5) == 25)
+
+  -- arguments adjusted to the parameters; several returns
+  f = inl([[
+    local function pick (c, a, b) if c then return a end return b end
+    local function three () return 1, 2, 3 end
+    return pick(three()), pick(false, three()), pick(), pick(1, 2, 3, 4)]])
+  local a, b, c, d = f()
+  assert(a == 2 and b == 2 and c == nil and d == 2)
+
+  -- upvalues become variables of the caller
+  f = inl([[
+    local up = 10
+    local function incr (d) up = up + d; return up end
+    local a = incr(1) + incr(2)
+    return a, up]])
+  a, b = f()
+  assert(a == 24 and b == 13)
+
+  -- assignments to the variable are seen by earlier expansions
+  f = inl([[
+    local function op (a, b) return a + b end
+    local t = {}
+    for i = 1, 2 do
+      t[i] = op(10, 3)
+      op = function (a, b) return a - b end
+    end
+    return t[1], t[2], op(10, 3)]])
+  a, b, c = f()
+  assert(a == 13 and b == 7 and c == 7)
+
+  -- recursive functions are not expanded
+  f = inl([[
+    local function fact (n) if n <= 1 then return 1 end return n * fact(n - 1) end
+    return (fact(5))]])
+  assert(f() == 120)
+  check(f, 'VARARGPREP', 'CLOSURE', 'MOVE', 'LOADI', 'CALL', 'RETURN')
+
+  -- errors have the lines of the expanded function
+  f = inl("local function idx (t)\n  return t.x\nend\nlocal y = 1\n" ..
+          "return idx(nil)")
+  local st, msg = pcall(f)
+  assert(not st and string.find(msg, "^inl:2:"))
+end
+
 print 'OK'
 
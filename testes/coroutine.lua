@@ -418,6 +418,31 @@ assert(C[1] == undef)
 assert(f() == 43 and f() == 53)
 
 
+-- finished coroutines release their stacks at once
+do
+  local function deep (n) if n == 0 then return 0 end return 1 + deep(n - 1) end
+  local cos = {}
+  collectgarbage()
+  local m = collectgarbage("count")
+  for i = 1, 100 do
+    local co = coroutine.create(deep)
+    assert(select(2, coroutine.resume(co, 1000)) == 1000)
+    assert(coroutine.status(co) == "dead")
+    cos[i] = co
+  end
+  cos[101] = coroutine.wrap(deep)
+  assert(cos[101](1000) == 1000)
+  collectgarbage()
+  -- each deep stack would take tens of Kbytes
+  assert(collectgarbage("count") - m < 200)
+  local st, msg = coroutine.resume(cos[1])
+  assert(not st and string.find(msg, "dead"))
+  assert(coroutine.close(cos[1]))
+  st, msg = pcall(cos[101])
+  assert(not st and string.find(msg, "dead"))
+end
+
+
 -- old bug: attempt to resume itself
 
 local function co_func (current_co)
@@ -967,6 +992,86 @@ assert(run(function ()
            end, {"for", "for", "for"}) == 10)
 
 
+if debug.setfuel then
+  print("testing fuel")
+  assert(debug.getfuel() == nil)   -- no limit
+
+  -- running out of fuel raises an error, once with a small reserve
+  local function spend (fuel, f, ...)
+    debug.setfuel(fuel)
+    local ok, msg = pcall(f, ...)
+    local ok2 = pcall(f, ...)   -- reserve cannot run the loop again
+    local left = debug.getfuel()
+    debug.setfuel()
+    assert(not ok and string.find(msg, "out of fuel") and not ok2)
+    return left
+  end
+  assert(spend(100, function () while true do end end) == 0)
+  spend(100, function () repeat until false end)
+  spend(100, function () ::l:: goto l end)
+  spend(100, function () for i = 1, math.huge do end end)
+  spend(100, function () for i = 1, 1e100, 1.0 do end end)
+  spend(100, function () for k in function () return 1 end do end end)
+  spend(100, function () local x = 1; repeat x = x + 1 until x < 0 end)
+  local function rec () return rec() end
+  spend(100, rec)
+  local function fwd (...) return fwd(...) end
+  spend(100, fwd, 1, 2)
+  local function deep (n) if n > 0 then deep(n - 1) end end
+  spend(100, deep, 10000)
+  -- enough fuel: nothing happens
+  debug.setfuel(100)
+  local s = 0
+  for i = 1, 10 do s = s + i end
+  local left = debug.getfuel()
+  debug.setfuel()
+  assert(s == 55 and left < 100 and left > 80)
+
+  -- yielding when out of fuel
+  local function sum (n)
+    local s = 0
+    for i = 1, n do s = s + i end
+    local t = {}
+    for k, v in ipairs({1, 2, 3, 4}) do t[#t + 1] = k * v end
+    local i = 0
+    while i < 10 do i = i + 1 end
+    repeat i = i - 1 until i < 0
+    return s, table.concat(t, " "), i
+  end
+  local co = coroutine.create(sum)
+  local nyields = 0
+  local ok, s, t, i
+  -- fuel is shared by all threads: refill it before this loop's back edge
+  debug.setfuel(3, "yield")
+  ok, s, t, i = coroutine.resume(co, 100)
+  debug.setfuel(3, "yield")
+  while coroutine.status(co) == "suspended" do
+    assert(ok and s == nil)   -- yielded with no values
+    nyields = nyields + 1
+    ok, s, t, i = coroutine.resume(co)
+    debug.setfuel(3, "yield")
+  end
+  debug.setfuel()
+  assert(ok and s == 5050 and t == "1 4 9 16" and i == -1)
+  assert(nyields > 40)
+  -- main thread cannot yield: fuel raises an error
+  debug.setfuel(10, "yield")
+  assert(not pcall(function () while true do end end))
+  assert(debug.getfuel() == 0)
+  debug.setfuel()
+  -- with hooks
+  local lines = 0
+  co = coroutine.create(sum)
+  debug.setfuel(5, "yield")
+  debug.sethook(co, function () lines = lines + 1 end, "l")
+  while coroutine.status(co) == "suspended" do
+    ok, s = coroutine.resume(co, 30)
+    debug.setfuel(5, "yield")
+  end
+  debug.setfuel()
+  assert(ok and s == 465 and lines > 0)
+end
+
 
 -- tests for coroutine API
 if T==nil then
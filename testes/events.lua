@@ -493,6 +493,47 @@ child = setmetatable({}, parent)
 child.foo = 10      --> CRASH (on some machines)
 assert(T == parent and K == "foo" and V == 10)
 
+do   print("testing deep chains of Lua metamethods")
+  -- each level calls the metamethod of the next one; they do not
+  -- recurse in C, so they are not bounded by the C stack
+  local N = 5000
+  local obj = {}
+  for i = 1, N do
+    local prev = obj
+    obj = setmetatable({}, {
+      __index = function (_, k) return prev[k] end,
+      __newindex = function (_, k, v) prev[k] = v end,
+    })
+  end
+  obj.x = 10   -- goes down N levels
+  assert(obj.x == 10 and rawget(obj, "x") == nil)
+
+  local depth = 0
+  local function rec (n)
+    return setmetatable({}, {__index = function (t, k)
+      if n == 0 then return debug.getinfo(1, "n") end
+      depth = depth + 1
+      return rec(n - 1)[k]
+    end, __unm = function (a)
+      return (n == 0) and 0 or -rec(n - 1) - 1
+    end})
+  end
+  local info = rec(1000).foo
+  assert(depth == 1000 and info.namewhat == "metamethod" and
+         info.name == "index")
+  assert(-rec(1000) == -1000)
+
+  -- errors and yields inside Lua metamethods
+  local t = setmetatable({}, {__index = function (t, k)
+    if k == "err" then error("in index") end
+    return coroutine.yield(k) * 2
+  end, __sub = function (a, b) return coroutine.yield(b) end})
+  local st, msg = pcall(function () return t.err end)
+  assert(not st and string.find(msg, "in index"))
+  local co = coroutine.wrap(function () return t.a + (t - 3) end)
+  assert(co() == "a" and co(10) == 3 and co(1) == 21)
+end
+
 print 'OK'
 
 return 12
@@ -581,6 +581,33 @@ assert(a == 20 and b == "\0\0\0" and c == nil)
 assert(os.remove(file))
 
 
+-- loading mapped binary files (mode "B")
+do
+  local long = string.rep("a long constant ", 500)
+  local code = string.rep("local x = 1; x = x + 1; ", 150) ..
+               "local t = {...}; return #t, ..., " .. string.format("%q", long)
+  io.output(io.open(file, "wb"))
+  assert(io.write(string.dump(assert(load(code)))))
+  io.close()
+  local f = assert(loadfile(file, "B"))
+  assert(os.remove(file))   -- mapping does not need the file
+  collectgarbage()
+  local n, a, s = f(10, 20)
+  assert(n == 2 and a == 10 and s == long)
+  -- small files and text files are read as usual
+  io.output(io.open(file, "wb"))
+  assert(io.write(string.dump(function () return 30 end)))
+  io.close()
+  assert(assert(loadfile(file, "B"))() == 30)
+  io.output(file); io.write("return 1"); io.close()
+  local st, msg = loadfile(file, "B")
+  assert(not st and string.find(msg, "text chunk"))
+  assert(os.remove(file))
+  assert(not loadfile(file, "B"))   -- no file
+  checkerr("invalid mode", loadfile, file, "Bt")
+end
+
+
 -- 'loadfile' with 'env'
 do
   local f = io.open(file, 'w')
@@ -343,6 +343,37 @@ GC()
 -- assert(next(a) == nil)
 
 
+do   print("long ephemeron chains")
+  -- each key keeps alive the next one only through the table; the time
+  -- to collect should be linear on the length of the chain
+  local N = 100000
+  local function chain (rev)
+    local a = setmetatable({}, mt)
+    local keys = {}
+    for i = 1, N do keys[i] = {} end
+    for i = 1, N - 1 do
+      local j = rev and N - i or i
+      a[keys[j]] = keys[j + 1]
+    end
+    return a, keys[1]
+  end
+  for _, rev in ipairs{false, true} do
+    local a, root = chain(rev)
+    collectgarbage()
+    local t = os.clock()
+    collectgarbage()
+    t = os.clock() - t
+    local n, i = root, 0
+    while n do n = a[n]; i = i + 1 end
+    assert(i == N)   -- whole chain is alive
+    print(string.format("  chain of %d: %.3f s", N, t))
+    root = nil
+    collectgarbage()
+    assert(next(a) == nil)   -- whole chain is gone
+  end
+end
+
+
 -- testing errors during GC
 if T then
   collectgarbage("stop")   -- stop collection
@@ -614,9 +645,11 @@ if T then
   t = T.totalmem("function")
   a = function () end   -- create 1 new closure
   assert(T.totalmem("function") == t + 1)
+  local size = collectgarbage("threadpool", 0)   -- no reused threads
   t = T.totalmem("thread")
   a = coroutine.create(function () end)   -- create 1 new coroutine
   assert(T.totalmem("thread") == t + 1)
+  collectgarbage("threadpool", size)
 end
 
 
@@ -675,6 +708,107 @@ do    -- check that the collector is not reentrant in incremental mode
 end
 
 
+do    print("memory limit")
+  collectgarbage()
+  local hits = collectgarbage("limithits")
+  local used = math.ceil(collectgarbage("count"))
+  assert(collectgarbage("limit", used + 200) == 0)
+  assert(collectgarbage("limit") == used + 200)
+  -- garbage is collected to make room for new objects
+  for i = 1, 100 do local a = string.rep("x", 10000 + i) end
+  assert(collectgarbage("limithits") == hits)
+  -- live data cannot grow beyond the limit
+  local t = {}
+  local st, msg = pcall(function ()
+    for i = 1, math.huge do t[i] = string.rep("x", 1000 + i) end
+  end)
+  assert(not st and msg == "not enough memory")
+  assert(collectgarbage("limithits") > hits)
+  assert(collectgarbage("count") <= used + 200)
+  t = nil
+  assert(collectgarbage("limit", 0) == used + 200)
+  assert(collectgarbage("limit") == 0)
+  local a = string.rep("x", 1000000)   -- no limit anymore
+end
+
+
+do    print("deferred finalizers")
+  local count = 0
+  local mt = {__gc = function () count = count + 1 end}
+  collectgarbage(); collectgarbage("runfinalizers")
+  assert(collectgarbage("deferfinalizers", true) == false)
+  assert(collectgarbage("deferfinalizers") == true)
+  for i = 1, 10 do setmetatable({}, mt) end
+  collectgarbage()
+  assert(count == 0)    -- finalizers are waiting
+  for i = 1, 10 do setmetatable({}, mt) end
+  collectgarbage("generational"); collectgarbage()
+  collectgarbage("incremental")
+  assert(count == 0)
+  assert(collectgarbage("runfinalizers", 3) == 3 and count == 3)
+  assert(collectgarbage("runfinalizers", 0) == 0 and count == 3)
+  assert(collectgarbage("runfinalizers") == 17 and count == 20)
+  assert(collectgarbage("runfinalizers") == 0)
+  -- objects are resurrected until their finalizers run
+  local x = setmetatable({}, {__gc = function (o) count = o end})
+  x = nil; collectgarbage()
+  assert(count == 20)
+  collectgarbage("runfinalizers")
+  assert(type(count) == "table"); count = 0
+  assert(collectgarbage("deferfinalizers", false) == true)
+  for i = 1, 10 do setmetatable({}, mt) end
+  collectgarbage()
+  assert(count == 10)   -- back to normal
+end
+
+
+do    print("thread pool")
+  local size = collectgarbage("threadpool")
+  assert(size >= 0 and collectgarbage("threadpool", 10) == size)
+  local function run (n)    -- create and finish 'n' coroutines
+    for i = 1, n do
+      local co = coroutine.wrap(function (a) return a + coroutine.yield() end)
+      co(i); assert(co(1) == i + 1)
+    end
+  end
+  collectgarbage()
+  run(20); collectgarbage()   -- pool gets 10 threads
+  collectgarbage("stop")
+  local hits = collectgarbage("threadhits")
+  local misses = collectgarbage("threadmisses")
+  run(15)
+  assert(collectgarbage("threadhits") == hits + 10)
+  assert(collectgarbage("threadmisses") == misses + 5)
+  collectgarbage("restart")
+  -- reused threads are as good as new ones
+  collectgarbage()
+  local f
+  local co = coroutine.create(function (...)
+    local x = select('#', ...)
+    f = function () x = x + 1; return x end
+    coroutine.yield(...)
+  end)
+  assert(coroutine.status(co) == "suspended")
+  assert(select('#', coroutine.resume(co, 1, 2, 3)) == 4)
+  co = nil; collectgarbage()    -- collect suspended coroutine
+  assert(f() == 4 and f() == 5)   -- its upvalue was closed
+  hits = collectgarbage("threadhits")
+  co = coroutine.create(function (...) return select('#', ...), ... end)
+  assert(collectgarbage("threadhits") == hits + 1)
+  local t = table.pack(coroutine.resume(co))
+  assert(t.n == 2 and t[1] and t[2] == 0)
+  assert(coroutine.status(co) == "dead")
+  -- an empty pool creates every thread anew
+  assert(collectgarbage("threadpool", 0) == 10)
+  collectgarbage()
+  run(10); collectgarbage()
+  hits = collectgarbage("threadhits")
+  run(10)
+  assert(collectgarbage("threadhits") == hits)
+  assert(collectgarbage("threadpool", size) == 0)
+end
+
+
 collectgarbage(oldmode)
 
 print('OK')
@@ -325,6 +325,32 @@ local s = "a string with \r and \n and \r\n and \n\r"
 local c = string.format("return %q", s)
 assert(assert(load(c))() == s)
 
+-- testing strings and comments split across blocks of the reader
+do
+  local line = string.rep("0123456789", 7)
+  local s = string.rep(line .. "]=]\r\n\\", 30)
+  local prog = "-- short comment " .. line .. "\n--[==[ " .. s ..
+               "]==] local a, b, c = 'x" .. line .. "\\n\"', [==[\n" .. s ..
+               "]==], \"" .. line .. "\\z   \n\t" .. line .. "\"" ..
+               "\n  \t  return a, b, c"
+  local a, b, c = assert(load(prog))()
+  assert(a == "x" .. line .. "\n\"")
+  assert(b == string.gsub(s, "\r\n", "\n"))
+  assert(c == line .. line)
+  for _, size in ipairs{1, 3, 7, 8, 9, 64, 100} do
+    local i = 1
+    local f = assert(load(function ()
+      local p = string.sub(prog, i, i + size - 1)
+      i = i + size
+      return p
+    end))
+    local a1, b1, c1 = f()
+    assert(a1 == a and b1 == b and c1 == c)
+  end
+  assert(not load("return 'x" .. line .. "\n'"))
+  assert(not load("return [==[" .. s))
+end
+
 -- testing errors
 assert(not load"a = 'non-ending string")
 assert(not load"a = 'non-ending string\n'")
@@ -0,0 +1,131 @@
+-- $Id: testes/sched.lua $
+-- See Copyright Notice in file all.lua
+
+print "testing scheduler"
+
+local sched = require "sched"
+
+local function checkerror (msg, f, ...)
+  local s, err = pcall(f, ...)
+  assert(not s and string.find(err, msg))
+end
+
+
+do   -- timers wake tasks in order
+  local out = {}
+  for _, d in ipairs{0.03, 0.01, 0.02, 0, 0.01} do
+    sched.spawn(function (x) sched.sleep(x); out[#out + 1] = x end, d)
+  end
+  assert(sched.count() == 5)
+  local t = sched.now()
+  sched.run()
+  assert(sched.now() - t >= 0.03)
+  assert(table.concat(out, " ") == "0 0.01 0.01 0.02 0.03")
+  assert(sched.count() == 0)
+  sched.run()   -- nothing to do
+end
+
+
+do   -- spawn, yield, and batches
+  local out = {}
+  local function task (name, n)
+    for i = 1, n do
+      out[#out + 1] = name .. i
+      if i % 2 == 0 then sched.yield() else coroutine.yield() end
+    end
+    return "ignored"
+  end
+  local co = sched.spawn(task, "a", 3)
+  assert(type(co) == "thread" and coroutine.status(co) == "suspended")
+  sched.spawn(task, "b", 2)
+  sched.spawn(function ()
+    out[#out + 1] = "c"
+    sched.spawn(task, "d", 1)    -- runs in the next batch
+  end)
+  sched.run()
+  assert(table.concat(out, " ") == "a1 b1 c a2 b2 d1 a3")
+  assert(coroutine.status(co) == "dead")
+end
+
+
+do   -- errors
+  checkerror("not called from a scheduler task", sched.sleep, 1)
+  checkerror("not called from a scheduler task", sched.yield)
+  -- a coroutine inside a task is not a task
+  sched.spawn(function ()
+    local co = coroutine.wrap(function () sched.yield() end)
+    checkerror("not called from a scheduler task", co)
+    checkerror("already running", sched.run)
+  end)
+  sched.run()
+
+  local closed = false
+  local done = false
+  sched.spawn(function () sched.sleep(0.01); done = true end)
+  sched.spawn(function ()
+    local x <close> = setmetatable({}, {__close = function ()
+      closed = true
+    end})
+    sched.yield()
+    error("task error")
+  end)
+  checkerror("task error", sched.run)
+  assert(closed and not done and sched.count() == 1)
+  sched.run()    -- remaining tasks go on
+  assert(done and sched.count() == 0)
+end
+
+
+if T and T.pipe and sched.wait then
+  print "testing waits for file descriptors"
+  local r, w = T.pipe()
+  local out = {}
+  sched.spawn(function ()
+    out[#out + 1] = sched.wait(r, "r")
+    out[#out + 1] = T.readfd(r)
+    out[#out + 1] = sched.wait(r, "r", 0.01)   -- times out
+    out[#out + 1] = sched.wait(r, "r", 10)   -- does not time out
+    out[#out + 1] = T.readfd(r)
+  end)
+  sched.spawn(function ()
+    assert(sched.wait(w, "w"))
+    sched.sleep(0.01)
+    T.writefd(w, "hello")
+    sched.sleep(0.05)
+    T.writefd(w, "bye")
+  end)
+  local t = sched.now()
+  sched.run()
+  assert(sched.now() - t < 1)   -- the timer of 10s did not hold the loop
+  assert(out[1] == true and out[2] == "hello")
+  assert(out[3] == false and out[4] == true and out[5] == "bye")
+  -- a descriptor can have only one waiting task
+  sched.spawn(function () sched.wait(r, "r", 0.01) end)
+  sched.spawn(function () sched.wait(r, "r", 0.01) end)
+  checkerror("cannot wait", sched.run)
+  sched.run()
+  sched.spawn(function () sched.wait(-1, "r") end)
+  checkerror("cannot wait", sched.run)
+  T.closefd(r); T.closefd(w)
+end
+
+
+do   -- many sleeping tasks
+  local N = _soft and 10000 or 100000
+  collectgarbage(); collectgarbage()
+  local m = collectgarbage("count")
+  local count = 0
+  for i = 1, N do
+    sched.spawn(function () sched.sleep(0.05); count = count + 1 end)
+  end
+  local mem
+  sched.spawn(function ()
+    sched.sleep(0.01)    -- all other tasks are asleep now
+    collectgarbage()
+    mem = (collectgarbage("count") - m) * 1024 / N
+  end)
+  sched.run()
+  assert(count == N and mem < 1500)
+end
+
+print "OK"
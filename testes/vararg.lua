@@ -147,5 +147,45 @@ do
   local a, b = g()
   assert(a == nil and b == 2)
 end
+do  print("testing vararg frames and forwarding")
+  -- calls without extra arguments keep the frame in place
+  local function f (a, b, ...)
+    assert(select('#', ...) == 0 and debug.getlocal(1, -1) == nil)
+    local x <close> = nil
+    return a, b, ...
+  end
+  local a, b, c = f(1)
+  assert(a == 1 and b == nil and c == nil)
+  local function g (a, ...) return select('#', ...), ... end
+  local function tg (a, ...) return g(a, ...) end
+  assert(tg(1) == 0 and select('#', tg(1, nil, nil)) == 3)
+
+  -- 'return f(...)' does not copy the arguments
+  local function fwd (...) return g(...) end
+  assert(fwd() == 0 and fwd(1) == 0)
+  local n, x, y = fwd(1, 2, 3)
+  assert(n == 2 and x == 2 and y == 3)
+  local t = {}
+  for i = 1, 300 do t[i] = i end
+  t = table.pack(fwd(table.unpack(t)))
+  assert(t.n == 300 and t[1] == 299 and t[2] == 2 and t[300] == 300)
+  local function cfwd (...) return select('#', ...) end
+  assert(cfwd() == 0 and cfwd(nil, nil) == 2)
+  local c = setmetatable({}, {__call = function (self, ...) return ... end})
+  local function mfwd (...) return c(...) end
+  a, b = mfwd(10, 20)
+  assert(a == 10 and b == 20)
+  -- with a count hook
+  local count = 0
+  debug.sethook(function () count = count + 1 end, "", 1)
+  n, x = fwd(1, 2)
+  debug.sethook()
+  assert(n == 1 and x == 2 and count > 0)
+  -- errors in the callee
+  local function err (...) return error(...) end
+  local st, msg = pcall(err, "x", 0)
+  assert(not st and msg == "x")
+end
+
 print('OK')
 